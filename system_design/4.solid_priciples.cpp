@@ -21,6 +21,27 @@ D - Dependency Inversion Principle (DIP)
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+#include <map>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 using namespace std;
 
 /*
@@ -95,8 +116,9 @@ public:
 
 class Logger {
 public:
+    // '\n' instead of endl: no stream flush on every call.
     void log(string message) {
-        cout << "LOG: " << message << endl;
+        cout << "LOG: " << message << '\n';
     }
 };
 
@@ -355,51 +377,2153 @@ public:
 };
 
 // ✅ GOOD EXAMPLE: Both depend on abstraction
+// Thrown by a backend when its connection has dropped.
+class ConnectionLost : public runtime_error {
+public:
+    ConnectionLost(const string& what) : runtime_error(what) {}
+};
+
 class Database {
+private:
+    mutex connectionMtx;  // one connection: one request at a time
+
 public:
     virtual void connect() = 0;
     virtual void save(string data) = 0;
+    // Connection lifecycle: connect once and keep using the connection;
+    // save() throws ConnectionLost once it has dropped.
+    virtual bool isConnected() const = 0;
+    virtual void disconnect() {}
+    // Many rows in one round trip; backends override when they can.
+    virtual void saveBatch(const vector<string>& rows) {
+        for (const string& row : rows) save(row);
+    }
+    virtual string getName() const = 0;
     virtual ~Database() = default;
+
+    // Connects on first use and reconnects once if the connection dropped.
+    // Safe to call from many threads.
+    void saveWithReconnect(const vector<string>& rows) {
+        lock_guard<mutex> lock(connectionMtx);
+        if (!isConnected()) connect();
+        try {
+            saveBatch(rows);
+        } catch (const ConnectionLost&) {
+            disconnect();
+            connect();
+            saveBatch(rows);
+        }
+    }
+
+    // The old per-write pattern (connect, then save), kept for comparison.
+    void connectAndSave(const string& row) {
+        lock_guard<mutex> lock(connectionMtx);
+        disconnect();
+        connect();
+        save(row);
+    }
+};
+
+// Requests and responses as they travel to a database server.
+enum DatabaseOp : uint8_t {
+    kOpHello = 0,  // server -> client greeting once the session is ready
+    kOpPing = 1,
+    kOpSave = 2,
+};
+
+struct DatabaseRequest {
+    uint64_t id;
+    uint8_t op;
+    vector<string> rows;
+};
+
+struct DatabaseResponse {
+    uint64_t id;
+    bool ok;
+    string message;
+};
+
+// One ordered, full-duplex connection to a server.
+class DatabaseTransport {
+public:
+    virtual bool send(const DatabaseRequest& request) = 0;
+    // Blocks for the next response; false once the connection is closed.
+    virtual bool receive(DatabaseResponse& response) = 0;
+    virtual void close() = 0;
+    virtual ~DatabaseTransport() = default;
+};
+
+// WIRE PROTOCOL (little-endian, length-prefixed frames over a Unix socket)
+//   frame    := u32 length, payload
+//   request  := u64 id, u8 op, u32 rowCount, rowCount x (u32 length, bytes)
+//   response := u64 id, u8 ok, u32 length, message bytes
+void putWire32(string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out += char(value >> (8 * i));
+}
+
+void putWire64(string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out += char(value >> (8 * i));
+}
+
+class WireReader {
+private:
+    const string& data;
+    size_t pos = 0;
+
+public:
+    bool ok = true;
+
+    WireReader(const string& data) : data(data) {}
+
+    uint64_t number(int bytes) {
+        if (pos + bytes > data.size()) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) value |= uint64_t((unsigned char)data[pos + i]) << (8 * i);
+        pos += bytes;
+        return value;
+    }
+
+    string text() {
+        uint32_t length = (uint32_t)number(4);
+        if (!ok || pos + length > data.size()) {
+            ok = false;
+            return "";
+        }
+        pos += length;
+        return data.substr(pos - length, length);
+    }
+
+    bool atEnd() const {
+        return ok && pos == data.size();
+    }
 };
 
-class MySQLDatabaseGood : public Database {
+string encodeRequest(const DatabaseRequest& request) {
+    string out;
+    putWire64(out, request.id);
+    out += char(request.op);
+    putWire32(out, (uint32_t)request.rows.size());
+    for (const string& row : request.rows) {
+        putWire32(out, (uint32_t)row.size());
+        out += row;
+    }
+    return out;
+}
+
+bool decodeRequest(const string& payload, DatabaseRequest& request) {
+    WireReader in(payload);
+    request.id = in.number(8);
+    request.op = (uint8_t)in.number(1);
+    uint32_t count = (uint32_t)in.number(4);
+    request.rows.clear();
+    for (uint32_t i = 0; i < count && in.ok; i++) request.rows.push_back(in.text());
+    return in.atEnd();
+}
+
+string encodeResponse(const DatabaseResponse& response) {
+    string out;
+    putWire64(out, response.id);
+    out += char(response.ok ? 1 : 0);
+    putWire32(out, (uint32_t)response.message.size());
+    out += response.message;
+    return out;
+}
+
+bool decodeResponse(const string& payload, DatabaseResponse& response) {
+    WireReader in(payload);
+    response.id = in.number(8);
+    response.ok = in.number(1) != 0;
+    response.message = in.text();
+    return in.atEnd();
+}
+
+bool writeAll(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+bool writeFrame(int fd, const string& payload) {
+    string frame;
+    putWire32(frame, (uint32_t)payload.size());
+    frame += payload;
+    return writeAll(fd, frame);
+}
+
+bool readExactly(int fd, char* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::recv(fd, buffer + done, size - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+bool readFrame(int fd, string& payload) {
+    static constexpr uint32_t kMaxFrame = 64 << 20;
+    char header[4];
+    if (!readExactly(fd, header, 4)) return false;
+    string headerText(header, 4);
+    uint32_t length = (uint32_t)WireReader(headerText).number(4);
+    if (length > kMaxFrame) return false;
+    payload.resize(length);
+    return readExactly(fd, &payload[0], length);
+}
+
+sockaddr_un unixAddress(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+// Connected stream socket, or -1.
+int connectUnixSocket(const string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un address = unixAddress(path);
+    if (::connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Listening socket at path (replacing a stale one); throws on failure.
+int listenUnixSocket(const string& path) {
+    ::unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = unixAddress(path);
+    if (fd < 0 || ::bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 128) != 0) {
+        string reason = strerror(errno);
+        if (fd >= 0) ::close(fd);
+        throw runtime_error("cannot listen on " + path + ": " + reason);
+    }
+    return fd;
+}
+
+// Client side of the wire protocol.
+class UnixSocketTransport : public DatabaseTransport {
+private:
+    int fd;
+
+    UnixSocketTransport(int fd) : fd(fd) {}
+
 public:
-    void connect() override { cout << "Connected to MySQL" << endl; }
-    void save(string data) override { cout << "Saving to MySQL: " << data << endl; }
+    // Connects and waits for the server's greeting; nullptr on failure.
+    static unique_ptr<UnixSocketTransport> open(const string& path) {
+        int fd = connectUnixSocket(path);
+        if (fd < 0) return nullptr;
+        unique_ptr<UnixSocketTransport> transport(new UnixSocketTransport(fd));
+        DatabaseResponse hello;
+        if (!transport->receive(hello) || !hello.ok) return nullptr;
+        return transport;
+    }
+
+    ~UnixSocketTransport() {
+        ::close(fd);
+    }
+
+    bool send(const DatabaseRequest& request) override {
+        return writeFrame(fd, encodeRequest(request));
+    }
+
+    bool receive(DatabaseResponse& response) override {
+        string payload;
+        return readFrame(fd, payload) && decodeResponse(payload, response);
+    }
+
+    // Unblocks a pending receive; the descriptor is released by the destructor.
+    void close() override {
+        shutdown(fd, SHUT_RDWR);
+    }
+};
+
+// Behaviour of a WireDatabaseServer; latencies model network + server time.
+struct WireServerOptions {
+    chrono::microseconds connectLatency{0};  // before the greeting
+    chrono::microseconds latency{0};         // per request
+    chrono::microseconds jitter{0};          // uniform extra per request
+    chrono::microseconds perRow{0};
+    double failureRate = 0;     // request answered with an error
+    double disconnectRate = 0;  // connection dropped instead of answering
+    uint32_t seed = 1;          // failures and jitter are reproducible
+};
+
+struct WireServerStats {
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t rows;
+    uint64_t injectedFailures;
+    uint64_t injectedDisconnects;
 };
 
-class PostgreSQLDatabase : public Database {
+// One thread per connection for the local servers below. A session that
+// ends reports itself with finish(); it is joined when the next session
+// starts, so a long-running server keeps one thread per open connection
+// rather than one per connection ever accepted. The owning server holds
+// its mutex around start() and finish(), and calls joinAll() without it
+// once no new session can start.
+class SessionThreads {
+private:
+    unordered_map<uint32_t, thread> running;  // by session number
+    vector<uint32_t> finished;                // exited, waiting to be joined
+    uint32_t started = 0;
+
 public:
-    void connect() override { cout << "Connected to PostgreSQL" << endl; }
-    void save(string data) override { cout << "Saving to PostgreSQL: " << data << endl; }
+    // Finished sessions no longer touch the server's mutex, so joining them
+    // here cannot deadlock.
+    template <typename Serve>
+    void start(Serve serve) {
+        for (uint32_t session : finished) {
+            auto it = running.find(session);
+            it->second.join();
+            running.erase(it);
+        }
+        finished.clear();
+        uint32_t session = started++;
+        running.emplace(session, thread(serve, session));
+    }
+
+    // The session's last touch of the server's state.
+    void finish(uint32_t session) {
+        finished.push_back(session);
+    }
+
+    void joinAll() {
+        for (auto& session : running) session.second.join();
+        running.clear();
+    }
+
+    uint32_t count() const {
+        return started;
+    }
 };
 
-class MongoDatabase : public Database {
+// Local database stand-in: speaks the wire protocol on a Unix socket and
+// keeps rows in memory. Each connection has a reader that handles requests
+// as they arrive and a writer that sends each response once its simulated
+// latency has passed, in request order, so pipelined requests overlap.
+class WireDatabaseServer {
+private:
+    string path;
+    WireServerOptions options;
+    int listenFd = -1;
+    thread acceptor;
+
+    mutex mtx;
+    vector<int> sessionFds;
+    SessionThreads sessions;
+    bool stopping = false;
+
+    atomic<uint64_t> requests{0}, rows{0}, injectedFailures{0}, injectedDisconnects{0};
+
+    void acceptLoop() {
+        while (true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;  // listening socket shut down
+            }
+            lock_guard<mutex> lock(mtx);
+            if (stopping) {
+                ::close(fd);
+                return;
+            }
+            sessionFds.push_back(fd);
+            sessions.start([this, fd](uint32_t session) { serve(fd, session); });
+        }
+    }
+
+    void serve(int fd, uint32_t session) {
+        struct Outgoing {
+            chrono::steady_clock::time_point due;
+            string payload;
+        };
+        mutex queueMtx;
+        condition_variable queueCv;
+        deque<Outgoing> outgoing;
+        bool readerDone = false;
+
+        thread writer([&] {
+            unique_lock<mutex> lock(queueMtx);
+            while (true) {
+                queueCv.wait(lock, [&] { return readerDone || !outgoing.empty(); });
+                if (outgoing.empty()) return;
+                auto due = outgoing.front().due;
+                if (chrono::steady_clock::now() < due) {
+                    queueCv.wait_until(lock, due);
+                    continue;
+                }
+                string payload = move(outgoing.front().payload);
+                outgoing.pop_front();
+                lock.unlock();
+                bool sent = writeFrame(fd, payload);
+                lock.lock();
+                if (!sent) return;
+            }
+        });
+        auto enqueue = [&](chrono::steady_clock::time_point due, const DatabaseResponse& response) {
+            lock_guard<mutex> lock(queueMtx);
+            outgoing.push_back({due, encodeResponse(response)});
+            queueCv.notify_one();
+        };
+
+        this_thread::sleep_for(options.connectLatency);
+        enqueue(chrono::steady_clock::now(), {0, true, "hello"});
+
+        mt19937 random(options.seed + session);
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto lastDue = chrono::steady_clock::now();
+        string payload;
+        DatabaseRequest request;
+        while (readFrame(fd, payload) && decodeRequest(payload, request)) {
+            requests++;
+            double roll = uniform(random);
+            if (roll < options.disconnectRate) {
+                injectedDisconnects++;
+                break;
+            }
+            DatabaseResponse response{request.id, true, ""};
+            if (roll < options.disconnectRate + options.failureRate) {
+                injectedFailures++;
+                response.ok = false;
+                response.message = "injected failure";
+            } else if (request.op == kOpSave) {
+                rows += request.rows.size();
+            }
+            chrono::microseconds delay = options.latency + options.perRow * (long long)request.rows.size()
+                                         + chrono::microseconds((long long)(options.jitter.count() * uniform(random)));
+            chrono::steady_clock::time_point due = chrono::steady_clock::now() + delay;
+            lastDue = max(lastDue, due);  // keep responses in order
+            enqueue(lastDue, response);
+        }
+
+        shutdown(fd, SHUT_RDWR);
+        {
+            lock_guard<mutex> lock(queueMtx);
+            readerDone = true;
+            outgoing.clear();
+            queueCv.notify_one();
+        }
+        writer.join();
+        lock_guard<mutex> lock(mtx);
+        sessionFds.erase(remove(sessionFds.begin(), sessionFds.end(), fd), sessionFds.end());
+        ::close(fd);
+        sessions.finish(session);
+    }
+
 public:
-    void connect() override { cout << "Connected to MongoDB" << endl; }
-    void save(string data) override { cout << "Saving to MongoDB: " << data << endl; }
+    WireDatabaseServer(const string& path, WireServerOptions options = WireServerOptions())
+        : path(path), options(options) {
+        listenFd = listenUnixSocket(path);
+        acceptor = thread(&WireDatabaseServer::acceptLoop, this);
+    }
+
+    WireDatabaseServer(const WireDatabaseServer&) = delete;
+    WireDatabaseServer& operator=(const WireDatabaseServer&) = delete;
+
+    ~WireDatabaseServer() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+            for (int fd : sessionFds) shutdown(fd, SHUT_RDWR);
+        }
+        shutdown(listenFd, SHUT_RDWR);
+        acceptor.join();
+        ::close(listenFd);
+        sessions.joinAll();
+        ::unlink(path.c_str());
+    }
+
+    const string& getPath() const {
+        return path;
+    }
+
+    WireServerStats stats() {
+        WireServerStats s;
+        {
+            lock_guard<mutex> lock(mtx);
+            s.connections = sessions.count();
+        }
+        s.rows = rows.load();
+        s.requests = requests.load();
+        s.injectedFailures = injectedFailures.load();
+        s.injectedDisconnects = injectedDisconnects.load();
+        return s;
+    }
+};
+
+// Per-process socket path for a demo/benchmark server.
+string localSocketPath(const string& name) {
+    return "/tmp/solid-" + name + "-" + to_string(getpid()) + ".sock";
+}
+
+// Per-process write-ahead log path for a demo/benchmark repository.
+string localWalPath(const string& name) {
+    return "/tmp/solid-" + name + "-" + to_string(getpid()) + ".wal";
+}
+
+// Talks to a WireDatabaseServer over one Unix-socket connection.
+class WireDatabase : public Database {
+private:
+    string name;
+    string socketPath;
+    bool verbose;
+    unique_ptr<UnixSocketTransport> connection;
+    uint64_t nextId = 1;
+
+    void roundTrip(const vector<string>& rows) {
+        if (!connection) throw ConnectionLost(name + ": not connected");
+        DatabaseRequest request{nextId++, kOpSave, rows};
+        DatabaseResponse response;
+        if (!connection->send(request) || !connection->receive(response)) {
+            connection.reset();
+            throw ConnectionLost(name + ": connection lost");
+        }
+        if (!response.ok) throw runtime_error(name + ": " + response.message);
+    }
+
+public:
+    WireDatabase(string name, string socketPath, bool verbose)
+        : name(name), socketPath(socketPath), verbose(verbose) {}
+
+    void connect() override {
+        connection = UnixSocketTransport::open(socketPath);
+        if (!connection) throw ConnectionLost(name + ": cannot connect to " + socketPath);
+        if (verbose) cout << "Connected to " << name << endl;
+    }
+
+    void disconnect() override {
+        connection.reset();
+    }
+
+    bool isConnected() const override {
+        return connection != nullptr;
+    }
+
+    void save(string data) override {
+        roundTrip({data});
+        if (verbose) cout << "Saving to " << name << ": " << data << endl;
+    }
+
+    void saveBatch(const vector<string>& rows) override {
+        roundTrip(rows);
+        if (verbose) {
+            for (const string& row : rows) cout << "Saving to " << name << ": " << row << endl;
+        }
+    }
+
+    string getName() const override {
+        return name;
+    }
+
+    // Simulates the connection dropping (server restart, idle timeout).
+    void dropConnection() {
+        if (connection) connection->close();
+    }
+};
+
+// Each backend also describes the server it stands in for.
+class MySQLDatabaseGood : public WireDatabase {
+public:
+    MySQLDatabaseGood(string socketPath, bool verbose = true) : WireDatabase("MySQL", socketPath, verbose) {}
+
+    static WireServerOptions serverProfile() {
+        WireServerOptions options;
+        options.connectLatency = chrono::microseconds(3000);
+        options.latency = chrono::microseconds(300);
+        options.jitter = chrono::microseconds(50);
+        options.perRow = chrono::microseconds(2);
+        return options;
+    }
+};
+
+class PostgreSQLDatabase : public WireDatabase {
+public:
+    PostgreSQLDatabase(string socketPath, bool verbose = true) : WireDatabase("PostgreSQL", socketPath, verbose) {}
+
+    static WireServerOptions serverProfile() {
+        WireServerOptions options;
+        options.connectLatency = chrono::microseconds(5000);
+        options.latency = chrono::microseconds(250);
+        options.jitter = chrono::microseconds(50);
+        options.perRow = chrono::microseconds(2);
+        return options;
+    }
+};
+
+class MongoDatabase : public WireDatabase {
+public:
+    MongoDatabase(string socketPath, bool verbose = true) : WireDatabase("MongoDB", socketPath, verbose) {}
+
+    static WireServerOptions serverProfile() {
+        WireServerOptions options;
+        options.connectLatency = chrono::microseconds(2000);
+        options.latency = chrono::microseconds(400);
+        options.jitter = chrono::microseconds(100);
+        options.perRow = chrono::microseconds(1);
+        return options;
+    }
+};
+
+// Group commit: concurrent writers queue their rows and block; a flusher
+// thread sends everything queued as one saveBatch once maxBatch rows are
+// waiting or the oldest has waited maxDelay, then wakes the writers.
+class GroupCommitWriter {
+private:
+    struct PendingWrite {
+        string row;
+        promise<void> done;
+    };
+
+    Database* db;
+    size_t maxBatch;
+    chrono::microseconds maxDelay;
+    mutex mtx;
+    condition_variable cv;
+    vector<PendingWrite> pending;
+    bool stopping = false;
+    thread flusher;
+    atomic<uint64_t> batches{0}, rows{0};
+
+    void run() {
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) return;  // stopping with nothing left
+            auto deadline = chrono::steady_clock::now() + maxDelay;
+            cv.wait_until(lock, deadline, [this] { return stopping || pending.size() >= maxBatch; });
+
+            vector<PendingWrite> batch;
+            batch.swap(pending);
+            lock.unlock();
+            vector<string> data;
+            data.reserve(batch.size());
+            for (auto& write : batch) data.push_back(move(write.row));
+            try {
+                db->saveWithReconnect(data);
+                for (auto& write : batch) write.done.set_value();
+            } catch (...) {
+                for (auto& write : batch) write.done.set_exception(current_exception());
+            }
+            batches++;
+            rows += batch.size();
+            lock.lock();
+        }
+    }
+
+public:
+    GroupCommitWriter(Database* db, size_t maxBatch = 64, chrono::microseconds maxDelay = chrono::microseconds(200))
+        : db(db), maxBatch(maxBatch), maxDelay(maxDelay) {
+        flusher = thread(&GroupCommitWriter::run, this);
+    }
+
+    // Flushes what is queued, then stops.
+    ~GroupCommitWriter() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        flusher.join();
+    }
+
+    future<void> submit(string row) {
+        PendingWrite write;
+        write.row = move(row);
+        future<void> done = write.done.get_future();
+        lock_guard<mutex> lock(mtx);
+        pending.push_back(move(write));
+        if (pending.size() == 1 || pending.size() >= maxBatch) cv.notify_one();
+        return done;
+    }
+
+    // Returns once the row is saved; rethrows the backend's error.
+    void write(string row) {
+        submit(move(row)).get();
+    }
+
+    double averageBatchSize() const {
+        return batches ? double(rows.load()) / batches.load() : 0;
+    }
+};
+
+// ASYNC, PIPELINED DATABASE ACCESS
+// A synchronous save keeps one request in flight per caller. Here requests
+// are written to the connection back to back without waiting, a completion
+// thread reads the responses (which arrive in request order) and fulfils
+// the matching futures, so one connection carries many saves at once.
+
+// In-process server stand-in: every request completes `latency` after it
+// was sent, regardless of how many others are in flight, and responses come
+// back in request order like on a real pipelined connection.
+class InProcessDatabaseServer {
+private:
+    struct Connection : DatabaseTransport {
+        InProcessDatabaseServer& server;
+        mutex mtx;
+        condition_variable ready;
+        deque<pair<chrono::steady_clock::time_point, DatabaseResponse>> responses;
+        bool closed = false;
+
+        Connection(InProcessDatabaseServer& server) : server(server) {}
+
+        // A closed connection applies nothing: the request never reached the server.
+        bool send(const DatabaseRequest& request) override {
+            lock_guard<mutex> lock(mtx);
+            if (closed) return false;
+            DatabaseResponse response = server.handle(request);
+            responses.push_back({chrono::steady_clock::now() + server.latency, move(response)});
+            ready.notify_one();
+            return true;
+        }
+
+        bool receive(DatabaseResponse& response) override {
+            unique_lock<mutex> lock(mtx);
+            while (true) {
+                ready.wait(lock, [this] { return closed || !responses.empty(); });
+                if (closed) return false;
+                auto due = responses.front().first;
+                if (chrono::steady_clock::now() >= due) break;
+                ready.wait_until(lock, due, [this] { return closed; });
+            }
+            response = move(responses.front().second);
+            responses.pop_front();
+            return true;
+        }
+
+        void close() override {
+            lock_guard<mutex> lock(mtx);
+            closed = true;
+            ready.notify_all();
+        }
+    };
+
+    chrono::microseconds latency;
+    atomic<size_t> savedRows{0};  // only counted: benchmarks would otherwise keep every row
+
+    DatabaseResponse handle(const DatabaseRequest& request) {
+        if (request.op == kOpSave) savedRows.fetch_add(request.rows.size(), memory_order_relaxed);
+        return {request.id, true, ""};
+    }
+
+public:
+    InProcessDatabaseServer(chrono::microseconds latency) : latency(latency) {}
+
+    unique_ptr<DatabaseTransport> connect() {
+        return make_unique<Connection>(*this);
+    }
+
+    size_t rowCount() {
+        return savedRows.load(memory_order_relaxed);
+    }
+};
+
+class AsyncDatabase {
+private:
+    unique_ptr<DatabaseTransport> transport;
+    size_t maxInFlight;
+    mutex mtx;                     // guards the send order and inFlight
+    condition_variable windowCv;   // a slot in the pipeline window freed up
+    deque<pair<uint64_t, promise<void>>> inFlight;
+    uint64_t nextId = 1;
+    bool broken = false;
+    thread completions;
+
+    // I/O thread: responses arrive in request order, so the oldest
+    // in-flight request is always the one being answered.
+    void completeResponses() {
+        DatabaseResponse response;
+        while (transport->receive(response)) {
+            promise<void> done;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (inFlight.empty() || inFlight.front().first != response.id) break;  // protocol error
+                done = move(inFlight.front().second);
+                inFlight.pop_front();
+                windowCv.notify_one();
+            }
+            if (response.ok) {
+                done.set_value();
+            } else {
+                done.set_exception(make_exception_ptr(runtime_error(response.message)));
+            }
+        }
+        // Connection gone: fail whatever is still waiting.
+        lock_guard<mutex> lock(mtx);
+        broken = true;
+        for (auto& request : inFlight) {
+            request.second.set_exception(make_exception_ptr(ConnectionLost("connection closed with request in flight")));
+        }
+        inFlight.clear();
+        windowCv.notify_all();
+    }
+
+public:
+    // Throws ConnectionLost when given no connection (a failed open()).
+    AsyncDatabase(unique_ptr<DatabaseTransport> connection, size_t maxInFlight = 128)
+        : transport(move(connection)), maxInFlight(max<size_t>(maxInFlight, 1)) {
+        if (!transport) throw ConnectionLost("AsyncDatabase: no connection");
+        completions = thread(&AsyncDatabase::completeResponses, this);
+    }
+
+    // Waits for outstanding requests, then closes the connection.
+    ~AsyncDatabase() {
+        {
+            unique_lock<mutex> lock(mtx);
+            windowCv.wait(lock, [this] { return inFlight.empty(); });
+        }
+        transport->close();
+        completions.join();
+    }
+
+    // Blocks only while maxInFlight requests are already outstanding.
+    future<void> saveBatchAsync(vector<string> rows) {
+        promise<void> done;
+        future<void> result = done.get_future();
+        unique_lock<mutex> lock(mtx);
+        windowCv.wait(lock, [this] { return broken || inFlight.size() < maxInFlight; });
+        if (broken) {
+            done.set_exception(make_exception_ptr(ConnectionLost("connection closed")));
+            return result;
+        }
+        DatabaseRequest request{nextId++, kOpSave, move(rows)};
+        inFlight.push_back({request.id, move(done)});
+        // Sent under the lock so wire order matches inFlight order. A failed
+        // send may have left a partial frame on the wire, so the connection
+        // is unusable: fail the whole window and every later request.
+        if (!transport->send(request)) {
+            broken = true;
+            transport->close();
+            for (auto& pending : inFlight) {
+                pending.second.set_exception(make_exception_ptr(ConnectionLost("send failed")));
+            }
+            inFlight.clear();
+            windowCv.notify_all();
+        }
+        return result;
+    }
+
+    future<void> saveAsync(string row) {
+        return saveBatchAsync({move(row)});
+    }
 };
 
 class UserServiceGood {
 private:
     Database* db;  // Depends on abstraction!
+    GroupCommitWriter* writer = nullptr;
 public:
     UserServiceGood(Database* database) : db(database) {}
+
+    // Concurrent saveUser calls share batched writes.
+    UserServiceGood(Database* database, GroupCommitWriter* groupWriter) : db(database), writer(groupWriter) {}
     
+    // Reuses one connection instead of connecting for every user.
     void saveUser(string userData) {
-        db->connect();
-        db->save(userData);
+        if (writer) {
+            writer->write(userData);
+        } else {
+            db->saveWithReconnect({userData});
+        }
     }
     // Can easily switch database without modifying this class!
 };
 
+// WRITE-BEHIND USER REPOSITORY
+// UserRepository writes through on every save. This one keeps users in
+// memory: save() updates the cache and marks the user dirty, repeated saves
+// of a dirty user collapse into one row, and a background flusher writes
+// dirty users to the database in batches of maxBatch or after maxDelay.
+// Reads are served from the cache, which holds every user ever saved
+// through the repository: it is a write buffer, not a bounded read cache.
+//
+// With a WAL path, every save is appended to a local log and fsynced before
+// it returns. A WAL thread group-commits records from concurrent saves, so
+// one fdatasync covers many saves and none of them runs under the cache
+// lock. A restarted repository replays the log, so saves acknowledged
+// before a crash are readable again and still reach the database. The log
+// is truncated whenever everything in it has been flushed, and rewritten
+// with just the unflushed users once it grows past walCheckpointBytes.
+struct WriteBehindOptions {
+    size_t maxBatch = 64;
+    chrono::milliseconds maxDelay{50};
+    string walPath;  // empty: no WAL, unflushed saves are lost on a crash
+    uint64_t walCheckpointBytes = 4 << 20;
+    chrono::milliseconds flushTimeout{5000};  // flush() and stop() give up after this
+};
+
+struct WriteBehindStats {
+    uint64_t saves;
+    uint64_t coalesced;  // saves that replaced a not-yet-flushed save
+    uint64_t flushes;
+    uint64_t rowsFlushed;
+    uint64_t flushFailures;
+    uint64_t recovered;  // users replayed from the WAL at startup
+    uint64_t walSyncs;   // fdatasync calls covering the saves above
+    uint64_t walCheckpoints;
+};
+
+class WriteBehindUserRepository {
+private:
+    // Every save gets the next sequence number; an entry is dirty while
+    // lastSeq > flushedSeq.
+    struct Entry {
+        User user;
+        uint64_t lastSeq = 0;
+        uint64_t flushedSeq = 0;         // lastSeq of the version in the database
+        uint64_t dirtySince = 0;         // oldest save not in the database, 0 when clean
+        uint64_t savedDuringFlush = 0;   // first save after the in-flight batch took the entry
+        bool queued = false;             // waiting in dirtyQueue
+        chrono::steady_clock::time_point queuedAt;
+
+        Entry(const User& user) : user(user) {}
+    };
+
+    struct PendingRecord {
+        string record;
+        promise<void> durable;
+    };
+
+    Database* db;
+    WriteBehindOptions options;
+    bool walEnabled;
+    int walFd = -1;  // swapped by checkpoints; only the WAL thread touches it once running
+
+    mutex mtx;
+    condition_variable flusherCv, flushedCv;
+    unordered_map<string, Entry> cache;  // by user name
+    deque<string> dirtyQueue;            // oldest first
+    map<uint64_t, string> dirtyBySeq;    // dirtySince -> name, oldest first
+    uint64_t lastSeq = 0;
+    bool flushRequested = false;
+    bool stopping = false;
+    chrono::steady_clock::time_point stopDeadline;  // flusher gives up retrying here
+    WriteBehindStats counters = {};
+    thread flusher;
+
+    // WAL thread state. Lock order: mtx, then walMtx.
+    mutex walMtx;
+    condition_variable walCv;
+    vector<PendingRecord> walPending;
+    bool walCompactRequested = false;
+    bool walStopping = false;
+    bool walCrashed = false;
+    uint64_t walBytes = 0;  // owned by the WAL thread after construction
+    atomic<uint64_t> walBytesSeen{0};  // walBytes, for the flusher to read
+    thread walWriter;
+
+    static uint32_t checksum(const string& data) {
+        uint32_t hash = 2166136261u;  // FNV-1a
+        for (unsigned char c : data) hash = (hash ^ c) * 16777619u;
+        return hash;
+    }
+
+    // Record: u32 length, u32 checksum, payload (name, email as wire text).
+    static string walRecord(const User& user) {
+        string payload, record;
+        putWire32(payload, (uint32_t)user.getName().size());
+        payload += user.getName();
+        putWire32(payload, (uint32_t)user.getEmail().size());
+        payload += user.getEmail();
+        putWire32(record, (uint32_t)payload.size());
+        putWire32(record, checksum(payload));
+        record += payload;
+        return record;
+    }
+
+    static bool writeAllAt(int fd, const string& data, uint64_t offset) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::pwrite(fd, data.data() + written, data.size() - written, offset + written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            written += n;
+        }
+        return true;
+    }
+
+    // Replays complete records; a torn tail from a crash mid-append is cut off.
+    void recoverFromWal() {
+        string log;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = ::read(walFd, buffer, sizeof(buffer))) > 0) log.append(buffer, n);
+        size_t pos = 0;
+        while (pos + 8 <= log.size()) {
+            string headerBytes = log.substr(pos, 8);
+            WireReader header(headerBytes);
+            uint32_t length = (uint32_t)header.number(4);
+            uint32_t sum = (uint32_t)header.number(4);
+            if (pos + 8 + length > log.size()) break;
+            string payload = log.substr(pos + 8, length);
+            if (checksum(payload) != sum) break;
+            WireReader in(payload);
+            string name = in.text();
+            string email = in.text();
+            if (!in.atEnd()) break;
+            markDirty(User(name, email), ++lastSeq);
+            pos += 8 + length;
+        }
+        if (ftruncate(walFd, pos) != 0) {
+            throw runtime_error("WAL recovery failed: " + string(strerror(errno)));
+        }
+        walBytes = pos;
+        walBytesSeen = pos;
+        counters.recovered = cache.size();
+    }
+
+    // Caller holds mtx. True if the save replaced one still waiting in
+    // dirtyQueue.
+    bool markDirty(const User& user, uint64_t seq) {
+        Entry& entry = cache.emplace(user.getName(), Entry(user)).first->second;
+        entry.user = user;
+        if (entry.lastSeq == entry.flushedSeq) {
+            entry.dirtySince = seq;
+            dirtyBySeq.emplace(seq, user.getName());
+        } else if (!entry.queued && entry.savedDuringFlush == 0) {
+            entry.savedDuringFlush = seq;  // dirty but not queued: in the flusher's batch
+        }
+        entry.lastSeq = seq;
+        if (entry.queued) return true;
+        entry.queued = true;
+        entry.queuedAt = chrono::steady_clock::now();
+        dirtyQueue.push_back(user.getName());
+        return false;
+    }
+
+    // Caller holds mtx. Records land in the WAL in the order saves reached
+    // the cache, so replay ends with the same user versions.
+    future<void> queueWalRecord(const User& user) {
+        lock_guard<mutex> lock(walMtx);
+        walPending.push_back({walRecord(user), promise<void>()});
+        walCv.notify_one();
+        return walPending.back().durable.get_future();
+    }
+
+    void walLoop() {
+        unique_lock<mutex> lock(walMtx);
+        while (true) {
+            walCv.wait(lock, [this] { return walStopping || !walPending.empty() || walCompactRequested; });
+            // Compaction first: under sustained saves walPending is rarely
+            // empty, and the log must not grow while it waits.
+            if (walCompactRequested && !walCrashed) {
+                walCompactRequested = false;
+                lock.unlock();
+                compactWal();
+                lock.lock();
+            }
+            walCompactRequested = false;
+            if (!walPending.empty()) {
+                vector<PendingRecord> batch;
+                batch.swap(walPending);
+                lock.unlock();
+                appendBatch(batch);
+                lock.lock();
+                continue;
+            }
+            if (walStopping) return;
+        }
+    }
+
+    // One write and one fdatasync for the whole batch. On failure the file
+    // is cut back to where the batch started, so a partial record never
+    // sits in front of later ones.
+    void appendBatch(vector<PendingRecord>& batch) {
+        string records;
+        for (auto& pending : batch) records += pending.record;
+        if (writeAllAt(walFd, records, walBytes) && fdatasync(walFd) == 0) {
+            walBytes += records.size();
+            walBytesSeen = walBytes;
+            {
+                lock_guard<mutex> lock(mtx);
+                counters.walSyncs++;
+            }
+            for (auto& pending : batch) pending.durable.set_value();
+            return;
+        }
+        string reason = strerror(errno);
+        if (ftruncate(walFd, walBytes) != 0) reason += "; rollback failed: " + string(strerror(errno));
+        auto error = make_exception_ptr(runtime_error("WAL write failed: " + reason));
+        for (auto& pending : batch) pending.durable.set_exception(error);
+    }
+
+    // Runs on the WAL thread, so no append interleaves with it. Users saved
+    // after the snapshot have records queued behind us and land in the new
+    // file; records of users in the snapshot that are still queued are just
+    // replayed twice.
+    void compactWal() {
+        string snapshot;
+        {
+            lock_guard<mutex> lock(mtx);
+            for (auto& dirty : dirtyBySeq) snapshot += walRecord(cache.at(dirty.second).user);
+        }
+        if (snapshot.empty()) {
+            if (walBytes > 0 && ftruncate(walFd, 0) == 0) {
+                walBytes = 0;
+                walBytesSeen = 0;
+            }
+            return;
+        }
+        if (walBytes <= options.walCheckpointBytes || snapshot.size() * 2 > walBytes) return;  // not worth it yet
+
+        // Write the snapshot beside the log, then rename it over the log.
+        string tmpPath = options.walPath + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return;
+        if (!writeAllAt(fd, snapshot, 0) || fdatasync(fd) != 0 || ::rename(tmpPath.c_str(), options.walPath.c_str()) != 0) {
+            ::close(fd);
+            ::unlink(tmpPath.c_str());
+            return;  // keep appending to the old log
+        }
+        syncParentDirectory(options.walPath);
+        ::close(walFd);
+        walFd = fd;
+        walBytes = snapshot.size();
+        walBytesSeen = walBytes;
+        lock_guard<mutex> lock(mtx);
+        counters.walCheckpoints++;
+    }
+
+    static void syncParentDirectory(const string& path) {
+        size_t slash = path.rfind('/');
+        string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        fsync(fd);
+        ::close(fd);
+    }
+
+    // Caller holds mtx.
+    void requestWalCompaction() {
+        if (!walEnabled) return;
+        lock_guard<mutex> lock(walMtx);
+        walCompactRequested = true;
+        walCv.notify_one();
+    }
+
+    void flushLoop() {
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            if (dirtyQueue.empty()) {
+                if (stopping) return;
+                flusherCv.wait(lock);
+                continue;
+            }
+            if (stopping && chrono::steady_clock::now() >= stopDeadline) return;  // database still down
+            // Wait for a full batch or for the oldest save to reach maxDelay.
+            auto due = cache.at(dirtyQueue.front()).queuedAt + options.maxDelay;
+            if (!stopping && !flushRequested && dirtyQueue.size() < options.maxBatch && chrono::steady_clock::now() < due) {
+                flusherCv.wait_until(lock, due);
+                continue;
+            }
+
+            vector<pair<string, uint64_t>> batch;  // name, lastSeq written
+            vector<string> rows;
+            while (!dirtyQueue.empty() && batch.size() < options.maxBatch) {
+                Entry& entry = cache.at(dirtyQueue.front());
+                dirtyQueue.pop_front();
+                entry.queued = false;
+                entry.savedDuringFlush = 0;
+                batch.push_back({entry.user.getName(), entry.lastSeq});
+                rows.push_back(entry.user.getName() + " <" + entry.user.getEmail() + ">");
+            }
+
+            lock.unlock();
+            bool ok = true;
+            try {
+                db->saveWithReconnect(rows);
+            } catch (const exception&) {
+                ok = false;
+            }
+            lock.lock();
+
+            if (!ok) {
+                // Requeue (unless saved again meanwhile) and back off.
+                counters.flushFailures++;
+                for (auto& written : batch) {
+                    Entry& entry = cache.at(written.first);
+                    entry.savedDuringFlush = 0;
+                    if (!entry.queued) {
+                        entry.queued = true;
+                        entry.queuedAt = chrono::steady_clock::now();
+                        dirtyQueue.push_back(written.first);
+                    }
+                }
+                flusherCv.wait_for(lock, options.maxDelay);
+                continue;
+            }
+            counters.flushes++;
+            counters.rowsFlushed += rows.size();
+            for (auto& written : batch) {
+                Entry& entry = cache.at(written.first);
+                entry.flushedSeq = written.second;
+                dirtyBySeq.erase(entry.dirtySince);
+                entry.dirtySince = entry.lastSeq == entry.flushedSeq ? 0 : entry.savedDuringFlush;
+                if (entry.dirtySince) dirtyBySeq.emplace(entry.dirtySince, written.first);
+                entry.savedDuringFlush = 0;
+            }
+            if (dirtyQueue.empty()) flushRequested = false;
+            if (dirtyBySeq.empty() || walBytesSeen > options.walCheckpointBytes) requestWalCompaction();
+            flushedCv.notify_all();
+        }
+    }
+
+    void stopWalWriter(bool crashed) {
+        {
+            lock_guard<mutex> lock(walMtx);
+            walStopping = true;
+            walCrashed = walCrashed || crashed;
+            walCv.notify_one();
+        }
+        if (walWriter.joinable()) walWriter.join();
+    }
+
+public:
+    WriteBehindUserRepository(Database* database, WriteBehindOptions options = WriteBehindOptions())
+        : db(database), options(options), walEnabled(!options.walPath.empty()) {
+        if (walEnabled) {
+            walFd = ::open(options.walPath.c_str(), O_RDWR | O_CREAT, 0644);
+            if (walFd < 0) throw runtime_error("cannot open WAL " + options.walPath + ": " + strerror(errno));
+            recoverFromWal();
+            walWriter = thread(&WriteBehindUserRepository::walLoop, this);
+        }
+        flusher = thread(&WriteBehindUserRepository::flushLoop, this);
+    }
+
+    WriteBehindUserRepository(const WriteBehindUserRepository&) = delete;
+    WriteBehindUserRepository& operator=(const WriteBehindUserRepository&) = delete;
+
+    ~WriteBehindUserRepository() {
+        stop();
+        if (walFd >= 0) ::close(walFd);
+    }
+
+    // Flushes what is left, retrying while the database is down for at
+    // most options.flushTimeout, then stops the background threads.
+    // Returns how many users are still not in the database: with a WAL a
+    // repository reopened on the same path replays them, without one they
+    // are lost. Later saves throw.
+    size_t stop() {
+        {
+            lock_guard<mutex> lock(mtx);
+            if (!stopping) {
+                stopping = true;
+                stopDeadline = chrono::steady_clock::now() + options.flushTimeout;
+            }
+            flusherCv.notify_one();
+        }
+        if (flusher.joinable()) flusher.join();
+        stopWalWriter(false);
+        lock_guard<mutex> lock(mtx);
+        return dirtyBySeq.size();
+    }
+
+    // Durable (with a WAL) when it returns; in the database later. If the
+    // WAL append fails this throws, but the save is already cached and
+    // will still be flushed; it just would not survive a crash. Throws
+    // once the repository is stopped or crashed.
+    void save(const User& user) {
+        future<void> durable;
+        {
+            lock_guard<mutex> lock(mtx);
+            if (stopping) throw runtime_error("WriteBehindUserRepository: save after stop");
+            counters.saves++;
+            if (markDirty(user, ++lastSeq)) counters.coalesced++;
+            if (dirtyQueue.size() >= options.maxBatch) flusherCv.notify_one();
+            if (walEnabled) durable = queueWalRecord(user);
+        }
+        if (durable.valid()) durable.get();
+    }
+
+    // Sees every save made through this repository, flushed or not.
+    bool find(const string& name, User& user) {
+        lock_guard<mutex> lock(mtx);
+        auto it = cache.find(name);
+        if (it == cache.end()) return false;
+        user = it->second.user;
+        return true;
+    }
+
+    // Blocks until every save that returned before the call is in the
+    // database; saves made meanwhile do not hold it up. False if that did
+    // not happen within options.flushTimeout or the repository is stopped.
+    bool flush() {
+        unique_lock<mutex> lock(mtx);
+        uint64_t target = lastSeq;
+        auto done = [this, target] { return dirtyBySeq.empty() || dirtyBySeq.begin()->first > target; };
+        if (done()) return true;
+        if (stopping) return false;
+        flushRequested = true;
+        flusherCv.notify_one();
+        return flushedCv.wait_for(lock, options.flushTimeout, done);
+    }
+
+    // Stops without flushing, as if the process died; only the WAL survives.
+    void simulateCrash() {
+        {
+            lock_guard<mutex> lock(mtx);
+            dirtyQueue.clear();
+            stopping = true;
+            flusherCv.notify_one();
+        }
+        flusher.join();
+        stopWalWriter(true);
+    }
+
+    WriteBehindStats stats() {
+        lock_guard<mutex> lock(mtx);
+        return counters;
+    }
+};
+
+// OUTBOUND EMAIL DELIVERY
+// EmailService sends on the caller's thread, so a slow relay stalls the
+// request that triggered the email. OutboundMailQueue takes the message,
+// returns at once and delivers in the background:
+//   - a worker pool, each worker with its own persistent relay connection
+//   - a token bucket per recipient domain (recipients per second, burst)
+//   - recipients of the same message to the same domain share one relay
+//     transaction (one MAIL, many RCPT, one DATA)
+//   - transient (4xx) failures retried with exponential backoff
+// The relay is reached over a small SMTP subset; LocalMailSink stands in
+// for it in demos and benchmarks.
+
+// Reads CRLF-terminated lines from a socket.
+class LineReader {
+private:
+    int fd;
+    string buffer;
+
+public:
+    LineReader(int fd) : fd(fd) {}
+
+    bool readLine(string& line) {
+        while (true) {
+            size_t end = buffer.find("\r\n");
+            if (end != string::npos) {
+                line = buffer.substr(0, end);
+                buffer.erase(0, end + 2);
+                return true;
+            }
+            char chunk[4096];
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer.append(chunk, n);
+        }
+    }
+};
+
+struct MailSinkOptions {
+    chrono::microseconds connectLatency{0};  // before the 220 greeting
+    chrono::microseconds perMessage{0};      // after the final "."
+    chrono::microseconds perRecipient{0};
+    double transientFailureRate = 0;  // message answered with 451
+    uint32_t seed = 1;
+};
+
+struct MailSinkStats {
+    uint64_t connections;
+    uint64_t messages;    // accepted transactions
+    uint64_t recipients;  // accepted recipients
+    uint64_t transientFailures;
+    unordered_map<string, uint64_t> recipientsByDomain;
+};
+
+// Local relay stand-in: accepts HELO, MAIL FROM, RCPT TO, DATA, RSET and
+// QUIT on a Unix socket, one thread per connection, and only counts what
+// it accepts.
+class LocalMailSink {
+private:
+    string path;
+    MailSinkOptions options;
+    int listenFd;
+    thread acceptor;
+
+    mutex mtx;
+    vector<int> sessionFds;
+    SessionThreads sessions;
+    bool stopping = false;
+    MailSinkStats counters = {};
+
+    void acceptLoop() {
+        while (true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+            lock_guard<mutex> lock(mtx);
+            if (stopping) {
+                ::close(fd);
+                return;
+            }
+            counters.connections++;
+            sessionFds.push_back(fd);
+            sessions.start([this, fd](uint32_t session) { serve(fd, session); });
+        }
+    }
+
+    void serve(int fd, uint32_t session) {
+        mt19937 random(options.seed + session);
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        LineReader in(fd);
+        vector<string> recipients;
+        string line;
+        this_thread::sleep_for(options.connectLatency);
+        bool open = writeAll(fd, "220 local-sink ready\r\n");
+        while (open && in.readLine(line)) {
+            string command = line.substr(0, 4);
+            transform(command.begin(), command.end(), command.begin(), ::toupper);
+            string reply;
+            if (command == "HELO" || command == "EHLO" || command == "MAIL" || command == "RSET") {
+                recipients.clear();
+                reply = "250 OK";
+            } else if (command == "RCPT") {
+                size_t start = line.find('<'), end = line.rfind('>');
+                if (start == string::npos || end == string::npos || end < start) {
+                    reply = "501 bad recipient";
+                } else {
+                    recipients.push_back(line.substr(start + 1, end - start - 1));
+                    reply = "250 OK";
+                }
+            } else if (command == "DATA") {
+                if (recipients.empty()) {
+                    reply = "503 no recipients";
+                } else {
+                    open = writeAll(fd, "354 end with .\r\n");
+                    while (open && (open = in.readLine(line)) && line != ".") {
+                    }
+                    if (!open) break;
+                    this_thread::sleep_for(options.perMessage + options.perRecipient * (long long)recipients.size());
+                    lock_guard<mutex> lock(mtx);
+                    if (uniform(random) < options.transientFailureRate) {
+                        counters.transientFailures++;
+                        reply = "451 try again later";
+                    } else {
+                        counters.messages++;
+                        counters.recipients += recipients.size();
+                        for (const string& to : recipients) counters.recipientsByDomain[to.substr(to.find('@') + 1)]++;
+                        reply = "250 queued";
+                    }
+                    recipients.clear();
+                }
+            } else if (command == "QUIT") {
+                writeAll(fd, "221 bye\r\n");
+                break;
+            } else {
+                reply = "500 unknown command";
+            }
+            open = writeAll(fd, reply + "\r\n");
+        }
+        lock_guard<mutex> lock(mtx);
+        sessionFds.erase(remove(sessionFds.begin(), sessionFds.end(), fd), sessionFds.end());
+        ::close(fd);
+        sessions.finish(session);
+    }
+
+public:
+    LocalMailSink(const string& path, MailSinkOptions options = MailSinkOptions())
+        : path(path), options(options), listenFd(listenUnixSocket(path)) {
+        acceptor = thread(&LocalMailSink::acceptLoop, this);
+    }
+
+    LocalMailSink(const LocalMailSink&) = delete;
+    LocalMailSink& operator=(const LocalMailSink&) = delete;
+
+    ~LocalMailSink() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+            for (int fd : sessionFds) shutdown(fd, SHUT_RDWR);
+        }
+        shutdown(listenFd, SHUT_RDWR);
+        acceptor.join();
+        ::close(listenFd);
+        sessions.joinAll();
+        ::unlink(path.c_str());
+    }
+
+    const string& getPath() const {
+        return path;
+    }
+
+    MailSinkStats stats() {
+        lock_guard<mutex> lock(mtx);
+        return counters;
+    }
+};
+
+// One SMTP session with a relay. Commands of a transaction are sent in one
+// write and the replies read afterwards (as with PIPELINING).
+class SmtpRelayConnection {
+private:
+    int fd;
+    LineReader in;
+
+    SmtpRelayConnection(int fd) : fd(fd), in(fd) {}
+
+    int readReply() {
+        string line;
+        if (!in.readLine(line) || line.size() < 3) throw ConnectionLost("relay connection lost");
+        return atoi(line.substr(0, 3).c_str());
+    }
+
+public:
+    // nullptr if the relay is unreachable or refuses the session.
+    static unique_ptr<SmtpRelayConnection> open(const string& path) {
+        int fd = connectUnixSocket(path);
+        if (fd < 0) return nullptr;
+        unique_ptr<SmtpRelayConnection> relay(new SmtpRelayConnection(fd));
+        try {
+            if (relay->readReply() != 220 || !writeAll(fd, "HELO localhost\r\n") || relay->readReply() != 250) return nullptr;
+        } catch (const ConnectionLost&) {
+            return nullptr;
+        }
+        return relay;
+    }
+
+    ~SmtpRelayConnection() {
+        writeAll(fd, "QUIT\r\n");
+        ::close(fd);
+    }
+
+    // One reply code per recipient: 250 delivered, 4xx retry later, 5xx
+    // give up. A recipient refused at RCPT keeps that reply; the others get
+    // the reply to the message. Throws ConnectionLost if the session breaks.
+    vector<int> deliver(const string& from, const vector<string>& recipients, const string& body) {
+        string commands = "MAIL FROM:<" + from + ">\r\n";
+        for (const string& to : recipients) commands += "RCPT TO:<" + to + ">\r\n";
+        commands += "DATA\r\n";
+        if (!writeAll(fd, commands)) throw ConnectionLost("relay connection lost");
+
+        int code = readReply();
+        vector<int> codes(recipients.size());
+        size_t accepted = 0;
+        for (int& rcptCode : codes) {
+            rcptCode = readReply();
+            if (rcptCode == 250) accepted++;
+        }
+        int dataReply = readReply();
+        if (code != 250 || accepted == 0 || dataReply != 354) {
+            // A started DATA cannot be cancelled; drop the session instead.
+            if (dataReply == 354) throw ConnectionLost("relay transaction aborted");
+            writeAll(fd, "RSET\r\n");
+            readReply();
+            int messageCode = code != 250 ? code : dataReply;
+            for (int& rcptCode : codes) {
+                if (code != 250 || rcptCode == 250) rcptCode = messageCode;
+            }
+            return codes;
+        }
+
+        string data;
+        size_t start = 0;
+        while (start <= body.size()) {
+            size_t end = body.find('\n', start);
+            string line = body.substr(start, end == string::npos ? string::npos : end - start);
+            data += (line.size() && line[0] == '.' ? "." : "") + line + "\r\n";  // dot-stuffing
+            if (end == string::npos) break;
+            start = end + 1;
+        }
+        data += ".\r\n";
+        if (!writeAll(fd, data)) throw ConnectionLost("relay connection lost");
+        int messageCode = readReply();
+        for (int& rcptCode : codes) {
+            if (rcptCode == 250) rcptCode = messageCode;
+        }
+        return codes;
+    }
+};
+
+// Recipients per second with bursts of up to `burst`.
+class TokenBucket {
+private:
+    double rate;
+    double burst;
+    double tokens;
+    chrono::steady_clock::time_point last;
+
+    void refill(chrono::steady_clock::time_point now) {
+        tokens = min(burst, tokens + rate * chrono::duration<double>(now - last).count());
+        last = now;
+    }
+
+public:
+    TokenBucket(double rate, double burst)
+        : rate(rate), burst(burst), tokens(burst), last(chrono::steady_clock::now()) {}
+
+    // Largest batch worth waiting for: `wanted`, capped by the burst.
+    size_t batchFor(size_t wanted) const {
+        return max<size_t>(1, min(wanted, (size_t)burst));
+    }
+
+    // All-or-nothing: takes batchFor(wanted) tokens, or none. Waiting for a
+    // full batch keeps the same rate with fewer, larger transactions.
+    size_t take(size_t wanted, chrono::steady_clock::time_point now) {
+        refill(now);
+        size_t batch = batchFor(wanted);
+        if (tokens < batch) return 0;
+        tokens -= batch;
+        return batch;
+    }
+
+    // Back at burst: a fresh bucket would behave the same.
+    bool full(chrono::steady_clock::time_point now) {
+        refill(now);
+        return tokens >= burst;
+    }
+
+    // When take(wanted) will succeed.
+    chrono::steady_clock::time_point readyAt(size_t wanted, chrono::steady_clock::time_point now) {
+        refill(now);
+        double missing = batchFor(wanted) - tokens;
+        if (missing <= 0) return now;
+        return now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(missing / rate));
+    }
+};
+
+struct OutboundMailOptions {
+    string relayPath;
+    string from = "no-reply@example.com";
+    int workers = 4;
+    size_t maxRecipientsPerMessage = 50;
+    double recipientsPerSecondPerDomain = 200;
+    double domainBurst = 20;
+    int maxAttempts = 5;
+    chrono::milliseconds initialBackoff{20};  // doubles on every retry
+};
+
+struct OutboundMailStats {
+    uint64_t enqueued;
+    uint64_t delivered;  // recipients
+    uint64_t failed;     // recipients given up on
+    uint64_t retries;
+    uint64_t transactions;
+    uint64_t connections;
+    double averageEnqueueMicros;
+    double p99EnqueueMicros;      // bucket upper bound
+    double deliveredPerSecond;    // since the first enqueue
+};
+
+class OutboundMailQueue {
+private:
+    struct Pending {
+        string to;
+        shared_ptr<const string> body;  // shared by a bulk send's recipients
+        int attempts = 0;
+        chrono::steady_clock::time_point notBefore;
+    };
+
+    struct Domain {
+        deque<Pending> ready;
+        vector<Pending> retrying;  // min-heap on notBefore
+        size_t delivering = 0;     // taken by a worker, not yet settled
+        TokenBucket bucket;
+
+        Domain(const OutboundMailOptions& options)
+            : bucket(options.recipientsPerSecondPerDomain, options.domainBurst) {}
+    };
+
+    static bool laterRetry(const Pending& a, const Pending& b) {
+        return a.notBefore > b.notBefore;
+    }
+
+    OutboundMailOptions options;
+    mutex mtx;
+    condition_variable workCv, idleCv;
+    unordered_map<string, Domain> domains;
+    vector<string> domainOrder;  // round-robin order for takeBatch
+    size_t nextDomain = 0;
+    size_t outstanding = 0;  // enqueued, not yet delivered or failed
+    bool stopping = false;
+    vector<thread> workers;
+
+    OutboundMailStats counters = {};
+    static constexpr int kLatencyBuckets = 32;  // bucket b: enqueue < 2^b ns
+    uint64_t enqueueNs = 0;
+    uint64_t enqueueLatency[kLatencyBuckets] = {};
+    chrono::steady_clock::time_point firstEnqueue, lastDelivery;
+
+    static string domainOf(const string& address) {
+        size_t at = address.rfind('@');
+        return at == string::npos ? "" : address.substr(at + 1);
+    }
+
+    // Caller holds mtx. Drops domains with nothing queued or in flight
+    // whose bucket has refilled, so domainOrder (and every scan of it)
+    // does not grow with each domain ever mailed. A dropped domain that
+    // comes back starts with the full bucket it would have had anyway.
+    void forgetIdleDomains(chrono::steady_clock::time_point now) {
+        size_t kept = 0, keptBeforeNext = 0;
+        for (size_t index = 0; index < domainOrder.size(); index++) {
+            auto it = domains.find(domainOrder[index]);
+            Domain& domain = it->second;
+            if (domain.ready.empty() && domain.retrying.empty() && domain.delivering == 0 && domain.bucket.full(now)) {
+                domains.erase(it);
+                continue;
+            }
+            if (index < nextDomain) keptBeforeNext++;
+            if (kept != index) domainOrder[kept] = move(domainOrder[index]);
+            kept++;
+        }
+        domainOrder.resize(kept);
+        nextDomain = keptBeforeNext;
+    }
+
+    // Caller holds mtx. Takes a batch that is due and within its domain's
+    // rate, or returns when the next one will be. Domains take turns, so a
+    // busy domain early in the order cannot starve the rest.
+    bool takeBatch(vector<Pending>& batch, chrono::steady_clock::time_point& wakeAt) {
+        auto now = chrono::steady_clock::now();
+        wakeAt = chrono::steady_clock::time_point::max();
+        forgetIdleDomains(now);
+        for (size_t i = 0; i < domainOrder.size(); i++) {
+            size_t index = (nextDomain + i) % domainOrder.size();
+            Domain& domain = domains.at(domainOrder[index]);
+            while (!domain.retrying.empty() && domain.retrying.front().notBefore <= now) {
+                pop_heap(domain.retrying.begin(), domain.retrying.end(), laterRetry);
+                domain.ready.push_front(move(domain.retrying.back()));
+                domain.retrying.pop_back();
+            }
+            if (!domain.retrying.empty()) wakeAt = min(wakeAt, domain.retrying.front().notBefore);
+            if (domain.ready.empty()) continue;
+
+            // Same body, consecutive in the queue: one transaction.
+            size_t sameBody = 1;
+            while (sameBody < domain.ready.size() && sameBody < options.maxRecipientsPerMessage
+                   && domain.ready[sameBody].body == domain.ready.front().body) {
+                sameBody++;
+            }
+            size_t allowed = domain.bucket.take(sameBody, now);
+            if (allowed == 0) {
+                wakeAt = min(wakeAt, domain.bucket.readyAt(sameBody, now));
+                continue;
+            }
+            for (size_t taken = 0; taken < allowed; taken++) {
+                batch.push_back(move(domain.ready.front()));
+                domain.ready.pop_front();
+            }
+            domain.delivering += allowed;
+            nextDomain = index + 1;
+            return true;
+        }
+        return false;
+    }
+
+    // Caller holds mtx. Idle workers only exit when woken with nothing
+    // outstanding, so wake them too.
+    void settle(size_t recipients) {
+        outstanding -= recipients;
+        if (outstanding == 0) {
+            idleCv.notify_all();
+            workCv.notify_all();
+        }
+    }
+
+    void workerLoop() {
+        unique_ptr<SmtpRelayConnection> relay;
+        vector<Pending> batch;
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            chrono::steady_clock::time_point wakeAt;
+            batch.clear();
+            if (!takeBatch(batch, wakeAt)) {
+                if (stopping && outstanding == 0) return;
+                if (wakeAt == chrono::steady_clock::time_point::max()) {
+                    workCv.wait(lock);
+                } else {
+                    workCv.wait_until(lock, wakeAt);
+                }
+                continue;
+            }
+            lock.unlock();
+
+            vector<string> recipients;
+            for (auto& pending : batch) recipients.push_back(pending.to);
+            vector<int> codes(batch.size(), 421);  // no relay: retry like a transient failure
+            bool reconnected = false;
+            bool attempted = false;
+            try {
+                if (!relay) {
+                    relay = SmtpRelayConnection::open(options.relayPath);
+                    reconnected = relay != nullptr;
+                }
+                if (relay) {
+                    attempted = true;
+                    codes = relay->deliver(options.from, recipients, *batch.front().body);
+                }
+            } catch (const ConnectionLost&) {
+                relay.reset();
+            }
+
+            lock.lock();
+            if (reconnected) counters.connections++;
+            if (attempted) counters.transactions++;
+            Domain& domain = domains.at(domainOf(batch.front().to));
+            domain.delivering -= batch.size();
+            size_t delivered = 0, gaveUp = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                Pending& pending = batch[i];
+                if (codes[i] == 250) {
+                    delivered++;
+                    continue;
+                }
+                if (codes[i] >= 500 || ++pending.attempts >= options.maxAttempts) {
+                    gaveUp++;
+                    continue;
+                }
+                counters.retries++;
+                pending.notBefore = chrono::steady_clock::now() + options.initialBackoff * (1 << (pending.attempts - 1));
+                domain.retrying.push_back(move(pending));
+                push_heap(domain.retrying.begin(), domain.retrying.end(), laterRetry);
+            }
+            if (delivered) lastDelivery = chrono::steady_clock::now();
+            counters.delivered += delivered;
+            counters.failed += gaveUp;
+            settle(delivered + gaveUp);
+            if (delivered + gaveUp < batch.size()) {
+                workCv.notify_all();  // a new retry time may be earlier than the others' wake-ups
+            }
+        }
+    }
+
+public:
+    OutboundMailQueue(OutboundMailOptions options) : options(options) {
+        if (options.workers < 1 || options.maxRecipientsPerMessage < 1 || options.maxAttempts < 1
+            || !(options.recipientsPerSecondPerDomain > 0) || !(options.domainBurst >= 1)) {
+            throw invalid_argument("OutboundMailQueue: workers, maxRecipientsPerMessage, maxAttempts, "
+                                   "recipientsPerSecondPerDomain and domainBurst must be positive, domainBurst at least 1");
+        }
+        for (int i = 0; i < options.workers; i++) workers.push_back(thread(&OutboundMailQueue::workerLoop, this));
+    }
+
+    OutboundMailQueue(const OutboundMailQueue&) = delete;
+    OutboundMailQueue& operator=(const OutboundMailQueue&) = delete;
+
+    // Delivers (or gives up on) everything still queued, then stops.
+    ~OutboundMailQueue() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+            workCv.notify_all();
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    // Queues one message for several recipients and returns without I/O.
+    void enqueueBulk(const vector<string>& recipients, string body) {
+        auto start = chrono::steady_clock::now();
+        auto shared = make_shared<const string>(move(body));
+        lock_guard<mutex> lock(mtx);
+        if (counters.enqueued == 0) firstEnqueue = start;
+        for (const string& to : recipients) {
+            string domainName = domainOf(to);
+            auto it = domains.find(domainName);
+            if (it == domains.end()) {
+                it = domains.emplace(domainName, Domain(options)).first;
+                domainOrder.push_back(domainName);
+            }
+            it->second.ready.push_back({to, shared, 0, {}});
+        }
+        counters.enqueued += recipients.size();
+        outstanding += recipients.size();
+        workCv.notify_one();
+
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        enqueueNs += ns;
+        int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        enqueueLatency[min(bucket, kLatencyBuckets - 1)]++;
+    }
+
+    void enqueue(const string& to, string body) {
+        enqueueBulk({to}, move(body));
+    }
+
+    // Blocks until every queued recipient is delivered or given up on.
+    void drain() {
+        unique_lock<mutex> lock(mtx);
+        idleCv.wait(lock, [this] { return outstanding == 0; });
+    }
+
+    OutboundMailStats stats() {
+        lock_guard<mutex> lock(mtx);
+        OutboundMailStats s = counters;
+        uint64_t calls = 0;
+        for (uint64_t count : enqueueLatency) calls += count;
+        s.averageEnqueueMicros = calls ? enqueueNs / 1000.0 / calls : 0;
+        s.p99EnqueueMicros = 0;
+        uint64_t seen = 0;
+        for (int b = 0; b < kLatencyBuckets && calls; b++) {
+            seen += enqueueLatency[b];
+            if (seen * 100 >= calls * 99) {
+                s.p99EnqueueMicros = (1ULL << b) / 1000.0;
+                break;
+            }
+        }
+        double seconds = chrono::duration<double>(lastDelivery - firstEnqueue).count();
+        s.deliveredPerSecond = s.delivered && seconds > 0 ? s.delivered / seconds : 0;
+        return s;
+    }
+};
+
+// Same call as EmailService::sendEmail, but returns before delivery.
+class QueuedEmailService {
+private:
+    OutboundMailQueue& queue;
+
+public:
+    QueuedEmailService(OutboundMailQueue& queue) : queue(queue) {}
+
+    void sendEmail(const User& user, string message) {
+        queue.enqueue(user.getEmail(), message);
+    }
+};
+
+// Write throughput per backend (run with --bench-db): the old
+// connect-per-write path, a persistent connection, and group commit.
+struct WriteBenchResult {
+    double writesPerSecond;
+    double averageMicros;
+    double p99Micros;
+    int errors;  // writes that threw
+};
+
+WriteBenchResult benchmarkWrites(function<void(const string&)> write, int threads, int writesPerThread) {
+    vector<vector<double>> latencies(threads);
+    atomic<int> errors(0);
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t] {
+            for (int i = 0; i < writesPerThread; i++) {
+                auto begin = chrono::steady_clock::now();
+                try {
+                    write("user-" + to_string(t) + "-" + to_string(i));
+                } catch (const exception&) {
+                    errors++;
+                }
+                latencies[t].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+            }
+        }));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    vector<double> all;
+    for (auto& perThread : latencies) all.insert(all.end(), perThread.begin(), perThread.end());
+    sort(all.begin(), all.end());
+    double sum = 0;
+    for (double latency : all) sum += latency;
+    WriteBenchResult result;
+    result.writesPerSecond = all.size() / seconds;
+    result.averageMicros = sum / all.size();
+    result.p99Micros = all[min(all.size() - 1, all.size() * 99 / 100)];
+    result.errors = errors.load();
+    return result;
+}
+
+void printWriteBench(const string& label, const WriteBenchResult& result) {
+    printf("  %-22s %9.0f writes/s  avg %8.1f us  p99 %8.1f us%s\n",
+           label.c_str(), result.writesPerSecond, result.averageMicros, result.p99Micros,
+           result.errors ? ("  errors " + to_string(result.errors)).c_str() : "");
+}
+
+void runDatabaseBenchmark() {
+    const int kThreads = 8, kWrites = 50;
+    WireDatabaseServer mysqlServer(localSocketPath("mysql"), MySQLDatabaseGood::serverProfile());
+    WireDatabaseServer postgresServer(localSocketPath("postgres"), PostgreSQLDatabase::serverProfile());
+    WireDatabaseServer mongoServer(localSocketPath("mongo"), MongoDatabase::serverProfile());
+    vector<unique_ptr<Database>> backends;
+    backends.push_back(make_unique<MySQLDatabaseGood>(mysqlServer.getPath(), false));
+    backends.push_back(make_unique<PostgreSQLDatabase>(postgresServer.getPath(), false));
+    backends.push_back(make_unique<MongoDatabase>(mongoServer.getPath(), false));
+    cout << kThreads << " threads x " << kWrites << " saveUser calls per backend (Unix-socket server stand-ins)" << endl;
+    for (auto& backend : backends) {
+        Database* db = backend.get();
+        cout << db->getName() << endl;
+        printWriteBench("connect per write", benchmarkWrites([db](const string& row) { db->connectAndSave(row); }, kThreads, kWrites));
+        UserServiceGood persistent(db);
+        printWriteBench("persistent connection", benchmarkWrites([&](const string& row) { persistent.saveUser(row); }, kThreads, kWrites));
+        GroupCommitWriter writer(db);
+        UserServiceGood grouped(db, &writer);
+        printWriteBench("group commit", benchmarkWrites([&](const string& row) { grouped.saveUser(row); }, kThreads, kWrites));
+        cout << "  average batch: " << writer.averageBatchSize() << " rows" << endl;
+    }
+
+    // One caller thread, one connection: a blocking save per write versus
+    // pipelined saves with up to 128 requests in flight.
+    const int kRequests = 2000;
+    InProcessDatabaseServer server(chrono::microseconds(300));
+    cout << "Single connection, 300 us per request, " << kRequests << " saves from one thread" << endl;
+    {
+        AsyncDatabase connection(server.connect(), 1);
+        printWriteBench("one in flight", benchmarkWrites([&](const string& row) { connection.saveAsync(row).get(); }, 1, kRequests / 10));
+    }
+    {
+        AsyncDatabase connection(server.connect(), 128);
+        vector<future<void>> results;
+        results.reserve(kRequests);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < kRequests; i++) {
+            results.push_back(connection.saveAsync("user-" + to_string(i)));
+        }
+        for (auto& result : results) {
+            result.get();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        printf("  %-22s %9.0f writes/s\n", "pipelined (128)", kRequests / seconds);
+    }
+    {
+        // Same over the wire protocol.
+        WireServerOptions options;
+        options.latency = chrono::microseconds(300);
+        WireDatabaseServer wireServer(localSocketPath("pipeline"), options);
+        unique_ptr<UnixSocketTransport> transport = UnixSocketTransport::open(wireServer.getPath());
+        if (!transport) {
+            printf("  %-22s could not connect\n", "pipelined, unix socket");
+        } else {
+            AsyncDatabase connection(move(transport), 128);
+            vector<future<void>> results;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < kRequests; i++) {
+                results.push_back(connection.saveAsync("user-" + to_string(i)));
+            }
+            for (auto& result : results) {
+                result.get();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            printf("  %-22s %9.0f writes/s\n", "pipelined, unix socket", kRequests / seconds);
+        }
+    }
+
+    {
+        // Bursty profile updates: 400 saves of 20 users.
+        auto profileOf = [](const string& row) {
+            string name = "user-" + to_string(hash<string>()(row) % 20);
+            return User(name, row + "@example.com");
+        };
+        MySQLDatabaseGood backing(mysqlServer.getPath(), false);
+        UserServiceGood writeThrough(&backing);
+        cout << "MySQL, 400 saves of 20 users" << endl;
+        printWriteBench("write-through", benchmarkWrites([&](const string& row) {
+            User user = profileOf(row);
+            writeThrough.saveUser(user.getName() + " <" + user.getEmail() + ">");
+        }, kThreads, kWrites));
+        for (bool withWal : {false, true}) {
+            WriteBehindOptions options;
+            if (withWal) options.walPath = localWalPath("bench");
+            WriteBehindStats stats;
+            {
+                WriteBehindUserRepository users(&backing, options);
+                printWriteBench(withWal ? "write-behind + WAL" : "write-behind",
+                                benchmarkWrites([&](const string& row) { users.save(profileOf(row)); }, kThreads, kWrites));
+                users.flush();
+                stats = users.stats();
+            }
+            printf("  %llu saves -> %llu rows in %llu flushes", (unsigned long long)stats.saves,
+                   (unsigned long long)stats.rowsFlushed, (unsigned long long)stats.flushes);
+            if (withWal) printf(", %llu WAL syncs", (unsigned long long)stats.walSyncs);
+            printf("\n");
+            if (withWal) ::unlink(options.walPath.c_str());
+        }
+    }
+
+    // Failure injection: 1% errors, 0.5% dropped connections. Drops are
+    // retried once after reconnecting; errors reach the caller.
+    WireServerOptions flaky = MySQLDatabaseGood::serverProfile();
+    flaky.failureRate = 0.01;
+    flaky.disconnectRate = 0.005;
+    WireDatabaseServer flakyServer(localSocketPath("flaky"), flaky);
+    MySQLDatabaseGood flakyMySQL(flakyServer.getPath(), false);
+    UserServiceGood flakyService(&flakyMySQL);
+    cout << "MySQL with injected failures" << endl;
+    printWriteBench("persistent connection", benchmarkWrites([&](const string& row) { flakyService.saveUser(row); }, kThreads, kWrites));
+    WireServerStats flakyStats = flakyServer.stats();
+    cout << "  server: " << flakyStats.requests << " requests, " << flakyStats.connections << " connections, "
+         << flakyStats.injectedFailures << " failures, " << flakyStats.injectedDisconnects << " disconnects injected" << endl;
+}
+
+// Email delivery (run with --bench-email): the caller talking to the relay
+// itself versus enqueueing, against a relay that costs ~1 ms per message
+// and defers 5% of them.
+void runEmailBenchmark() {
+    const int kThreads = 4, kEmails = 100;
+    MailSinkOptions relay;
+    relay.connectLatency = chrono::microseconds(2000);
+    relay.perMessage = chrono::microseconds(1000);
+    relay.perRecipient = chrono::microseconds(50);
+    relay.transientFailureRate = 0.05;
+    vector<string> domains = {"gmail.com", "yahoo.com", "outlook.com", "example.org"};
+    OutboundMailOptions options;
+    options.recipientsPerSecondPerDomain = 1000;
+    options.domainBurst = 50;
+    auto addressOf = [&](const string& id) { return id + "@" + domains[hash<string>()(id) % domains.size()]; };
+    cout << kThreads << " threads x " << kEmails << " welcome emails to " << domains.size() << " domains (queue limit "
+         << options.recipientsPerSecondPerDomain << " recipients/s per domain)" << endl;
+    {
+        LocalMailSink sink(localSocketPath("mail-sync"), relay);
+        printWriteBench("send on caller thread", benchmarkWrites([&](const string& id) {
+            auto connection = SmtpRelayConnection::open(sink.getPath());
+            if (!connection || connection->deliver("no-reply@example.com", {addressOf(id)}, "Welcome!")[0] != 250) {
+                throw runtime_error("not delivered");
+            }
+        }, kThreads, kEmails));
+    }
+    for (bool bulk : {false, true}) {
+        LocalMailSink sink(localSocketPath("mail-queue"), relay);
+        options.relayPath = sink.getPath();
+        OutboundMailQueue queue(options);
+        if (bulk) {
+            // One newsletter to every address: recipients share transactions.
+            vector<string> everyone;
+            for (int t = 0; t < kThreads; t++) {
+                for (int i = 0; i < kEmails; i++) everyone.push_back(addressOf("user-" + to_string(t) + "-" + to_string(i)));
+            }
+            sort(everyone.begin(), everyone.end(), [](const string& a, const string& b) {
+                return a.substr(a.find('@')) < b.substr(b.find('@'));
+            });
+            queue.enqueueBulk(everyone, "Our newsletter");
+        } else {
+            printWriteBench("enqueue", benchmarkWrites([&](const string& id) { queue.enqueue(addressOf(id), "Welcome!"); }, kThreads, kEmails));
+        }
+        queue.drain();
+        OutboundMailStats stats = queue.stats();
+        printf("  %-22s %9.0f recipients/s delivered  %llu transactions, %llu retries, %llu failed, enqueue p99 < %.1f us\n",
+               bulk ? "newsletter" : "queued delivery", stats.deliveredPerSecond, (unsigned long long)stats.transactions,
+               (unsigned long long)stats.retries, (unsigned long long)stats.failed, stats.p99EnqueueMicros);
+    }
+}
+
 /*
 ═══════════════════════════════════════════════════════════════════════════
     DEMONSTRATION & TESTING
 ═══════════════════════════════════════════════════════════════════════════
 */
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench-db") {
+        runDatabaseBenchmark();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-email") {
+        runEmailBenchmark();
+        return 0;
+    }
+
     cout << "\n" << string(75, '=') << endl;
     cout << "SOLID PRINCIPLES DEMONSTRATION" << endl;
     cout << string(75, '=') << endl;
@@ -415,6 +2539,26 @@ int main() {
     repo.save(user);
     emailSvc.sendEmail(user, "Welcome!");
     logger.log("User created: " + user.getName());
+    {
+        // Outbound queue: sendEmail returns before the relay is contacted.
+        MailSinkOptions relay;
+        relay.perMessage = chrono::microseconds(5000);
+        LocalMailSink sink(localSocketPath("mail"), relay);
+        OutboundMailOptions options;
+        options.relayPath = sink.getPath();
+        OutboundMailQueue outbound(options);
+        QueuedEmailService queuedEmail(outbound);
+        auto start = chrono::steady_clock::now();
+        for (const char* name : {"Bob", "Carol", "Dave"}) {
+            queuedEmail.sendEmail(User(name, string(name) + "@example.com"), "Welcome!");
+        }
+        auto queued = chrono::steady_clock::now() - start;
+        outbound.drain();
+        cout << "Queued 3 welcome emails in " << chrono::duration_cast<chrono::microseconds>(queued).count()
+             << " us; relay accepted " << sink.stats().recipients << " after "
+             << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+        cout << "Email throughput: " << argv[0] << " --bench-email" << endl;
+    }
     
     // 2. OCP Demo
     cout << "\n2. OPEN/CLOSED PRINCIPLE:" << endl;
@@ -448,9 +2592,13 @@ int main() {
     // 5. DIP Demo
     cout << "\n5. DEPENDENCY INVERSION PRINCIPLE:" << endl;
     cout << string(50, '-') << endl;
-    MySQLDatabaseGood mysql;
-    PostgreSQLDatabase postgres;
-    MongoDatabase mongo;
+    // Each backend talks to a local stand-in server over a Unix socket.
+    WireDatabaseServer mysqlServer(localSocketPath("mysql"), MySQLDatabaseGood::serverProfile());
+    WireDatabaseServer postgresServer(localSocketPath("postgres"), PostgreSQLDatabase::serverProfile());
+    WireDatabaseServer mongoServer(localSocketPath("mongo"), MongoDatabase::serverProfile());
+    MySQLDatabaseGood mysql(mysqlServer.getPath());
+    PostgreSQLDatabase postgres(postgresServer.getPath());
+    MongoDatabase mongo(mongoServer.getPath());
     
     UserServiceGood service1(&mysql);
     service1.saveUser("User1");
@@ -460,6 +2608,49 @@ int main() {
     
     UserServiceGood service3(&mongo);
     service3.saveUser("User3");
+    service3.saveUser("User4");  // same connection, no reconnect
+    mongo.dropConnection();
+    service3.saveUser("User5");  // reconnects once, then saves
+    InProcessDatabaseServer server(chrono::microseconds(500));
+    {
+        AsyncDatabase pipelined(server.connect());
+        vector<future<void>> saves;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 100; i++) {
+            saves.push_back(pipelined.saveAsync("User" + to_string(100 + i)));
+        }
+        for (auto& save : saves) {
+            save.get();
+        }
+        cout << "100 pipelined saves at 500 us each took "
+             << chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count()
+             << " us on one connection (" << server.rowCount() << " rows stored)" << endl;
+    }
+    {
+        // Write-behind: 30 profile updates for 3 users become 3 rows.
+        MySQLDatabaseGood cacheBacking(mysqlServer.getPath(), false);
+        WriteBehindOptions options;
+        options.walPath = localWalPath("users");
+        WriteBehindUserRepository users(&cacheBacking, options);
+        for (int i = 0; i < 30; i++) {
+            string name = "Member" + to_string(i % 3);
+            users.save(User(name, name + "+v" + to_string(i) + "@example.com"));
+        }
+        User cached("", "");
+        users.find("Member1", cached);
+        cout << "Read from cache before any flush: " << cached.getEmail() << endl;
+        users.simulateCrash();
+
+        WriteBehindUserRepository restarted(&cacheBacking, options);
+        restarted.find("Member1", cached);
+        cout << "After a crash the WAL restores " << restarted.stats().recovered
+             << " users, e.g. " << cached.getEmail() << endl;
+        restarted.flush();
+        WriteBehindStats stats = restarted.stats();
+        cout << "Flushed " << stats.rowsFlushed << " rows in " << stats.flushes << " batch(es)" << endl;
+        ::unlink(options.walPath.c_str());
+    }
+    cout << "Throughput per backend: " << argv[0] << " --bench-db" << endl;
     
     cout << "\n" << string(75, '=') << endl;
     cout << "SUMMARY - Remember: SOLID" << endl;
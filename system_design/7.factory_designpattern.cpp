@@ -132,76 +132,715 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <array>
+#include <variant>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "factory_instrumentation.h"
 
 using namespace std;
 
+// ============================================================================
+// TYPE REGISTRY (self-registering products, O(1) lookup)
+// ============================================================================
+// Products register themselves from static initializers, so adding a type
+// never touches the factory. Names are hashed at compile time (FNV-1a) and
+// the first lookup freezes the registry into a minimal perfect hash table
+// (hash and displace): one bucket read, one slot read and one key compare
+// per lookup, however many types are registered.
+
+constexpr uint64_t vehicleKey(string_view name) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (char c : name) {
+        hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+class Vehicle;
+
+// Returns a pooled object to the pool of its concrete type.
+struct VehicleRecycler {
+    void (*recycle)(Vehicle*) = nullptr;
+
+    void operator()(Vehicle* vehicle) const {
+        recycle(vehicle);
+    }
+};
+
+typedef unique_ptr<Vehicle, VehicleRecycler> PooledVehicle;
+
+class VehicleFleet;
+
+class VehicleRegistry {
+public:
+    typedef unique_ptr<Vehicle> (*Creator)();
+    typedef PooledVehicle (*PooledCreator)();
+    typedef void (*FleetAppender)(VehicleFleet&, size_t count);
+
+    struct Slot {
+        uint64_t key = 0;
+        string_view name;
+        Creator create = nullptr;
+        PooledCreator createPooled = nullptr;
+        FleetAppender appendTo = nullptr;
+    };
+
+private:
+
+    vector<Slot> registered;
+    vector<Slot> slots;            // power-of-two sized perfect hash table
+    vector<uint32_t> displacement; // one per bucket
+    uint64_t slotMask = 0;
+    once_flag built;
+    bool frozen = false;
+
+    VehicleRegistry() {}
+
+    static uint64_t mix(uint64_t key, uint64_t seed) {
+        uint64_t x = key ^ (seed * 0x9E3779B97F4A7C15ULL);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    size_t bucketOf(uint64_t key) const {
+        return (key >> 32) % displacement.size();
+    }
+
+    // Places the largest buckets first; each bucket searches for a
+    // displacement that sends all of its keys to free slots.
+    void build() {
+        frozen = true;
+        size_t tableSize = 1;
+        while (tableSize < registered.size() + registered.size() / 4 + 1) tableSize <<= 1;
+        size_t bucketCount = max<size_t>(1, registered.size() / 4);
+        while (true) {
+            vector<vector<const Slot*>> buckets(bucketCount);
+            displacement.assign(bucketCount, 0);
+            for (auto& entry : registered) buckets[bucketOf(entry.key)].push_back(&entry);
+            vector<size_t> order(bucketCount);
+            for (size_t i = 0; i < bucketCount; i++) order[i] = i;
+            sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+            slots.assign(tableSize, Slot());
+            slotMask = tableSize - 1;
+            vector<bool> used(tableSize, false);
+            bool placedAll = true;
+            for (size_t bucket : order) {
+                if (buckets[bucket].empty()) break;
+                uint32_t d = 0;
+                vector<size_t> positions;
+                for (; d < (1u << 16); d++) {
+                    positions.clear();
+                    for (const Slot* entry : buckets[bucket]) {
+                        size_t position = mix(entry->key, d) & slotMask;
+                        if (used[position] || std::find(positions.begin(), positions.end(), position) != positions.end()) break;
+                        positions.push_back(position);
+                    }
+                    if (positions.size() == buckets[bucket].size()) break;
+                }
+                if (positions.size() != buckets[bucket].size()) {
+                    placedAll = false;
+                    break;
+                }
+                displacement[bucket] = d;
+                for (size_t i = 0; i < positions.size(); i++) {
+                    used[positions[i]] = true;
+                    slots[positions[i]] = *buckets[bucket][i];
+                }
+            }
+            if (placedAll) return;
+            tableSize <<= 1;  // practically never: retry with more room
+        }
+    }
+
+public:
+    // Function-local static: safe to use from other static initializers.
+    static VehicleRegistry& instance() {
+        static VehicleRegistry registry;
+        return registry;
+    }
+
+    // Called from static initializers (see VehicleRegistrar).
+    void add(string_view name, Creator create, PooledCreator createPooled, FleetAppender appendTo) {
+        uint64_t key = vehicleKey(name);
+        if (frozen) throw logic_error("vehicle type registered after first lookup: " + string(name));
+        for (auto& entry : registered) {
+            if (entry.key == key) throw logic_error("duplicate vehicle type or hash: " + string(name));
+        }
+        Slot slot;
+        slot.key = key;
+        slot.name = name;
+        slot.create = create;
+        slot.createPooled = createPooled;
+        slot.appendTo = appendTo;
+        registered.push_back(slot);
+    }
+
+    // nullptr for unknown keys.
+    const Slot* find(uint64_t key, string_view name) {
+        call_once(built, [this] { build(); });
+        if (registered.empty()) return nullptr;
+        const Slot& slot = slots[mix(key, displacement[bucketOf(key)]) & slotMask];
+        if (slot.key != key || slot.name != name) return nullptr;
+        return &slot;
+    }
+
+    unique_ptr<Vehicle> createByKey(uint64_t key, string_view name) {
+        const Slot* slot = find(key, name);
+        return slot ? slot->create() : nullptr;
+    }
+
+    unique_ptr<Vehicle> create(string_view name) {
+        return createByKey(vehicleKey(name), name);
+    }
+
+    PooledVehicle createPooled(string_view name) {
+        const Slot* slot = find(vehicleKey(name), name);
+        return slot ? slot->createPooled() : nullptr;
+    }
+
+    size_t size() const {
+        return registered.size();
+    }
+};
+
 // Abstract Product - Base class for all vehicles
 class Vehicle {
 public:
     virtual void drive() = 0;
     virtual string getType() = 0;
+    // One simulation step. Products also provide a non-virtual step() that
+    // VehicleFleet calls directly.
+    virtual void tick() = 0;
+    // Called instead of the destructor when a pooled object is recycled;
+    // products with per-use state clear it here.
+    virtual void reset() {}
     virtual ~Vehicle() = default;
 };
 
+// ============================================================================
+// OBJECT POOL (pooled creation mode)
+// ============================================================================
+// One pool per concrete type. Objects are carved from 64-object chunks and
+// never destroyed, only reset() and reused. Each thread keeps a small free
+// list of its own so acquire/release normally touch no lock and no shared
+// memory; only refills and overflow go through the pool's mutex. Once the
+// pool has grown to the working set, the allocator is not called at all.
+// Handles must be released before the pool is destroyed at program exit.
+struct VehiclePoolStats {
+    uint64_t chunks;
+    uint64_t objects;
+    uint64_t acquires;
+};
+
+template <typename T>
+class VehiclePool {
+private:
+    static constexpr size_t kChunkSize = 64;
+    static constexpr size_t kThreadCacheLimit = 128;  // beyond this, half goes back
+
+    struct ThreadCache {
+        vector<T*> free;
+
+        ThreadCache() {
+            free.reserve(kThreadCacheLimit + 1);
+        }
+
+        ~ThreadCache() {
+            instance().giveBack(free, free.size());
+        }
+    };
+
+    mutex mtx;
+    vector<T*> shared;
+    vector<unique_ptr<T[]>> chunks;
+    atomic<uint64_t> acquires{0};
+
+    VehiclePool() {}
+
+    static ThreadCache& threadCache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static void recycle(Vehicle* vehicle) {
+        instance().release(static_cast<T*>(vehicle));
+    }
+
+    void refill(vector<T*>& local) {
+        lock_guard<mutex> lock(mtx);
+        if (shared.empty()) {
+            chunks.push_back(unique_ptr<T[]>(new T[kChunkSize]));
+            for (size_t i = 0; i < kChunkSize; i++) shared.push_back(&chunks.back()[i]);
+        }
+        size_t take = min(shared.size(), kThreadCacheLimit / 2);
+        local.insert(local.end(), shared.end() - take, shared.end());
+        shared.resize(shared.size() - take);
+    }
+
+    void giveBack(vector<T*>& local, size_t count) {
+        lock_guard<mutex> lock(mtx);
+        shared.insert(shared.end(), local.end() - count, local.end());
+        local.resize(local.size() - count);
+    }
+
+public:
+    static VehiclePool& instance() {
+        static VehiclePool pool;
+        return pool;
+    }
+
+    PooledVehicle acquire() {
+        vector<T*>& local = threadCache().free;
+        if (local.empty()) refill(local);
+        T* vehicle = local.back();
+        local.pop_back();
+        acquires.fetch_add(1, memory_order_relaxed);
+        return PooledVehicle(vehicle, VehicleRecycler{&recycle});
+    }
+
+    void release(T* vehicle) {
+        vehicle->reset();
+        vector<T*>& local = threadCache().free;
+        local.push_back(vehicle);
+        if (local.size() > kThreadCacheLimit) giveBack(local, local.size() / 2);
+    }
+
+    VehiclePoolStats stats() {
+        lock_guard<mutex> lock(mtx);
+        VehiclePoolStats s;
+        s.chunks = chunks.size();
+        s.objects = chunks.size() * kChunkSize;
+        s.acquires = acquires.load();
+        return s;
+    }
+};
+
+// ============================================================================
+// FLEET (batch creation into per-type contiguous storage)
+// ============================================================================
+// vector<unique_ptr<Vehicle>> costs a pointer chase and a virtual call per
+// element. A fleet keeps one contiguous vector per concrete type instead,
+// so a pass over it is one virtual call per type and then a tight loop of
+// inlinable, non-virtual step() calls. Products must be final and have a
+// non-virtual step().
+class VehicleFleet {
+private:
+    struct SegmentBase {
+        virtual ~SegmentBase() = default;
+        virtual void stepAll() = 0;
+        virtual size_t size() const = 0;
+    };
+
+    template <typename T>
+    struct Segment : SegmentBase {
+        vector<T> vehicles;
+
+        void stepAll() override {
+            for (T& vehicle : vehicles) vehicle.step();  // T is final: direct call
+        }
+
+        size_t size() const override {
+            return vehicles.size();
+        }
+    };
+
+    // Dense small ids for product types, assigned on first use.
+    static size_t nextTypeId() {
+        static atomic<size_t> next{0};
+        return next++;
+    }
+
+    template <typename T>
+    static size_t typeId() {
+        static const size_t id = nextTypeId();
+        return id;
+    }
+
+    vector<unique_ptr<SegmentBase>> segments;  // indexed by typeId
+    size_t unknown = 0;
+
+    friend class VehicleFactory;
+
+public:
+    template <typename T>
+    vector<T>& segment() {
+        size_t id = typeId<T>();
+        if (segments.size() <= id) segments.resize(id + 1);
+        if (!segments[id]) segments[id] = make_unique<Segment<T>>();
+        return static_cast<Segment<T>&>(*segments[id]).vehicles;
+    }
+
+    template <typename T>
+    void append(size_t count) {
+        vector<T>& vehicles = segment<T>();
+        vehicles.resize(vehicles.size() + count);
+    }
+
+    // Steps every vehicle, type by type.
+    void forEachDrive() {
+        for (auto& segment : segments) {
+            if (segment) segment->stepAll();
+        }
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (auto& segment : segments) {
+            if (segment) total += segment->size();
+        }
+        return total;
+    }
+
+    // Names in the batch that were not registered.
+    size_t unknownCount() const {
+        return unknown;
+    }
+};
+
+// One static instance per product registers it before main() runs.
+template <typename T>
+struct VehicleRegistrar {
+    static constexpr uint64_t kKey = vehicleKey(T::kName);
+
+    VehicleRegistrar() {
+        VehicleRegistry::instance().add(T::kName,
+            [] () -> unique_ptr<Vehicle> { return FACTORY_CREATE(T, sizeof(T), make_unique<T>()); },
+            [] () -> PooledVehicle { return VehiclePool<T>::instance().acquire(); },
+            [] (VehicleFleet& fleet, size_t count) { fleet.append<T>(count); });
+    }
+};
+
 // Concrete Product 1 - Car
-class Car : public Vehicle {
+class Car final : public Vehicle {
+private:
+    double distance = 0;
+    FACTORY_TRACKED(Car)
+
 public:
+    static constexpr string_view kName = "Car";
+
     void drive() override {
         cout << "Driving a car on the road!" << endl;
     }
     
     string getType() override {
-        return "Car";
+        return string(kName);
+    }
+
+    void step() {
+        distance += 1.0;
+    }
+
+    void tick() override {
+        step();
+    }
+
+    void reset() override {
+        distance = 0;
+    }
+
+    double getDistance() const {
+        return distance;
     }
 };
 
+static VehicleRegistrar<Car> registerCar;
+
 // Concrete Product 2 - Bike
-class Bike : public Vehicle {
+class Bike final : public Vehicle {
+private:
+    double distance = 0;
+    FACTORY_TRACKED(Bike)
+
 public:
+    static constexpr string_view kName = "Bike";
+
     void drive() override {
         cout << "Riding a bike on the road!" << endl;
     }
     
     string getType() override {
-        return "Bike";
+        return string(kName);
+    }
+
+    void step() {
+        distance += 0.25;
+    }
+
+    void tick() override {
+        step();
+    }
+
+    void reset() override {
+        distance = 0;
+    }
+
+    double getDistance() const {
+        return distance;
     }
 };
 
+static VehicleRegistrar<Bike> registerBike;
+
 // Concrete Product 3 - Truck
-class Truck : public Vehicle {
+class Truck final : public Vehicle {
+private:
+    double distance = 0;
+    FACTORY_TRACKED(Truck)
+
 public:
+    static constexpr string_view kName = "Truck";
+
     void drive() override {
         cout << "Driving a heavy truck!" << endl;
     }
     
     string getType() override {
-        return "Truck";
+        return string(kName);
+    }
+
+    void step() {
+        distance += 0.8;
+    }
+
+    void tick() override {
+        step();
+    }
+
+    void reset() override {
+        distance = 0;
+    }
+
+    double getDistance() const {
+        return distance;
     }
 };
 
+static VehicleRegistrar<Truck> registerTruck;
+
 // Factory Class - Creates objects based on input
 class VehicleFactory {
 public:
-    // Factory Method
+    // Factory Method: a registry lookup instead of an if/else chain, so new
+    // products only need a VehicleRegistrar. Unknown types return nullptr.
     static unique_ptr<Vehicle> createVehicle(const string& type) {
-        if (type == "Car") {
-            return make_unique<Car>();
-        }
-        else if (type == "Bike") {
-            return make_unique<Bike>();
+        return VehicleRegistry::instance().create(type);
+    }
+
+    // Recycled object from the type's pool; returns to it when the handle
+    // is destroyed. Unknown types return nullptr.
+    static PooledVehicle createPooledVehicle(const string& type) {
+        return VehicleRegistry::instance().createPooled(type);
+    }
+
+    // Batch creation: counts the batch per type first, then appends each
+    // type's vehicles to its contiguous segment in one resize. Takes a
+    // vector rather than std::span since this code targets C++17.
+    static VehicleFleet createVehicles(const vector<string>& types) {
+        VehicleRegistry& registry = VehicleRegistry::instance();
+        vector<pair<const VehicleRegistry::Slot*, size_t>> counts;
+        VehicleFleet fleet;
+        for (const string& type : types) {
+            const VehicleRegistry::Slot* slot = registry.find(vehicleKey(type), type);
+            if (!slot) {
+                fleet.unknown++;
+                continue;
+            }
+            auto it = find_if(counts.begin(), counts.end(), [slot](const pair<const VehicleRegistry::Slot*, size_t>& c) {
+                return c.first == slot;
+            });
+            if (it == counts.end()) {
+                counts.push_back({slot, 1});
+            } else {
+                it->second++;
+            }
         }
-        else if (type == "Truck") {
-            return make_unique<Truck>();
+        for (auto& count : counts) {
+            count.first->appendTo(fleet, count.second);
         }
-        else {
-            cout << "Invalid vehicle type!" << endl;
-            return nullptr;
+        return fleet;
+    }
+
+    // Key computed at compile time, e.g. createVehicle<Truck>().
+    template <typename T>
+    static unique_ptr<Vehicle> createVehicle() {
+        return VehicleRegistry::instance().createByKey(VehicleRegistrar<T>::kKey, T::kName);
+    }
+};
+
+// ============================================================================
+// VARIANT FACTORY (closed product set, no allocation, no virtual dispatch)
+// ============================================================================
+// When the product set is fixed at compile time, products can be returned
+// by value in a std::variant and dispatched with std::visit: no heap
+// allocation, and since every alternative is final the compiler sees the
+// concrete type and can inline drive()/step(). Lives alongside the
+// unique_ptr<Vehicle> API; the name -> index table is constexpr.
+template <typename... Ts>
+class VariantFactory {
+private:
+    static_assert((is_final_v<Ts> && ...), "variant products must be final so calls devirtualize");
+
+    static constexpr array<uint64_t, sizeof...(Ts)> kKeys = {vehicleKey(Ts::kName)...};
+    static constexpr array<string_view, sizeof...(Ts)> kNames = {Ts::kName...};
+
+    template <size_t I>
+    static variant<Ts...> make() {
+        return variant<Ts...>(in_place_index<I>);
+    }
+
+    template <size_t... Is>
+    static variant<Ts...> makeAt(size_t index, index_sequence<Is...>) {
+        static constexpr variant<Ts...> (*makers[])() = {&make<Is>...};
+        return makers[index]();
+    }
+
+public:
+    typedef variant<Ts...> Product;
+    static constexpr size_t npos = sizeof...(Ts);
+
+    // Usable in constant expressions: indexOf("Truck") folds to a constant.
+    static constexpr size_t indexOf(string_view name) {
+        uint64_t key = vehicleKey(name);
+        for (size_t i = 0; i < sizeof...(Ts); i++) {
+            if (kKeys[i] == key && kNames[i] == name) return i;
         }
+        return npos;
+    }
+
+    // nullopt for unknown names.
+    static optional<Product> create(string_view name) {
+        size_t index = indexOf(name);
+        if (index == npos) return nullopt;
+        return makeAt(index, index_sequence_for<Ts...>());
+    }
+
+    template <typename T>
+    static Product create() {
+        return Product(in_place_type<T>);
     }
 };
 
+typedef VariantFactory<Car, Bike, Truck> VehicleVariantFactory;
+typedef VehicleVariantFactory::Product VehicleVariant;
+
+static_assert(VehicleVariantFactory::indexOf("Truck") == 2, "name -> index resolves at compile time");
+
+// Fleet iteration benchmark (run with --bench-fleet [vehicles])
+template <typename T>
+double totalDistance(const vector<unique_ptr<Vehicle>>& vehicles) {
+    double total = 0;
+    for (auto& vehicle : vehicles) {
+        if (T* typed = dynamic_cast<T*>(vehicle.get())) total += typed->getDistance();
+    }
+    return total;
+}
+
+template <typename T>
+double totalDistance(const vector<VehicleVariant>& vehicles) {
+    double total = 0;
+    for (auto& vehicle : vehicles) {
+        if (const T* typed = get_if<T>(&vehicle)) total += typed->getDistance();
+    }
+    return total;
+}
+
+template <typename T>
+double totalDistance(VehicleFleet& fleet) {
+    double total = 0;
+    for (T& vehicle : fleet.segment<T>()) total += vehicle.getDistance();
+    return total;
+}
+
+void benchmarkFleet(size_t count) {
+    const int kPasses = 20;
+    const string names[] = {"Car", "Bike", "Truck"};
+    vector<string> types;
+    types.reserve(count);
+    uint64_t seed = 42;
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        types.push_back(names[(seed >> 33) % 3]);
+    }
+
+    vector<unique_ptr<Vehicle>> pointers;
+    pointers.reserve(count);
+    for (const string& type : types) pointers.push_back(VehicleFactory::createVehicle(type));
+    auto start = chrono::steady_clock::now();
+    for (int pass = 0; pass < kPasses; pass++) {
+        for (auto& vehicle : pointers) vehicle->tick();
+    }
+    double pointerNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (double(count) * kPasses);
+
+    vector<VehicleVariant> variants;
+    variants.reserve(count);
+    for (const string& type : types) variants.push_back(*VehicleVariantFactory::create(type));
+    start = chrono::steady_clock::now();
+    for (int pass = 0; pass < kPasses; pass++) {
+        for (auto& vehicle : variants) visit([](auto& v) { v.step(); }, vehicle);
+    }
+    double variantNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (double(count) * kPasses);
+
+    start = chrono::steady_clock::now();
+    VehicleFleet fleet = VehicleFactory::createVehicles(types);
+    double createMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    for (int pass = 0; pass < kPasses; pass++) {
+        fleet.forEachDrive();
+    }
+    double fleetNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (double(count) * kPasses);
+
+    double pointerTotal = totalDistance<Car>(pointers) + totalDistance<Bike>(pointers) + totalDistance<Truck>(pointers);
+    double variantTotal = totalDistance<Car>(variants) + totalDistance<Bike>(variants) + totalDistance<Truck>(variants);
+    double fleetTotal = totalDistance<Car>(fleet) + totalDistance<Bike>(fleet) + totalDistance<Truck>(fleet);
+    cout << count << " vehicles, " << kPasses << " passes" << endl;
+    cout << "  vector<unique_ptr<Vehicle>>: " << pointerNs << " ns/vehicle" << endl;
+    cout << "  vector<VehicleVariant>:      " << variantNs << " ns/vehicle" << endl;
+    cout << "  VehicleFleet::forEachDrive:  " << fleetNs << " ns/vehicle (batch create " << createMs << " ms)" << endl;
+    cout << "  distances match: " << (pointerTotal == fleetTotal && variantTotal == fleetTotal ? "yes" : "NO") << endl;
+}
+
+// Heap vs pooled create+destroy (run with --bench-pool [requests])
+void benchmarkPool(size_t requests) {
+    if (requests == 0) requests = 1;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < requests; i++) {
+        auto vehicle = VehicleFactory::createVehicle("Car");
+    }
+    auto heapNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < requests; i++) {
+        auto vehicle = VehicleFactory::createPooledVehicle("Car");
+    }
+    auto pooledNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    VehiclePoolStats poolStats = VehiclePool<Car>::instance().stats();
+    cout << "Create+destroy x" << requests << ": heap " << heapNs / requests << " ns, pooled "
+         << pooledNs / requests << " ns (" << poolStats.objects << " Car objects ever allocated)" << endl;
+}
+
 // Client Code
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench-fleet") {
+        benchmarkFleet(argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-pool") {
+        benchmarkPool(argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
 
     // auto bike = VehicleFactory::createVehicle("Bike");
     // see man this a typical example for the code ok! here the clinet will request the factory
@@ -235,12 +874,46 @@ int main() {
     
     // Try invalid type
     auto invalid = VehicleFactory::createVehicle("Plane");
+    if (!invalid) {
+        cout << "Invalid vehicle type!" << endl;
+    }
+
+    auto registered = VehicleFactory::createVehicle<Truck>();
+    cout << "Registry: " << VehicleRegistry::instance().size() << " types, compile-time key lookup -> "
+         << registered->getType() << endl;
+
+    // Pooled mode: short-lived products are recycled instead of freed
+    for (int i = 0; i < 3; i++) {
+        auto vehicle = VehicleFactory::createPooledVehicle("Car");
+    }
+    VehiclePoolStats poolStats = VehiclePool<Car>::instance().stats();
+    cout << "Pooled Cars: " << poolStats.acquires << " acquires served by " << poolStats.chunks << " chunk of "
+         << poolStats.objects << " objects; compare with: " << argv[0] << " --bench-pool" << endl;
+
+    // Closed-set variant factory: by value, dispatched with std::visit
+    optional<VehicleVariant> inlineBike = VehicleVariantFactory::create("Bike");
+    if (inlineBike) {
+        visit([](auto& vehicle) {
+            cout << "Variant factory created: " << vehicle.getType() << " (no allocation) -> ";
+            vehicle.drive();
+        }, *inlineBike);
+    }
+
+    // Batch creation into per-type contiguous storage
+    VehicleFleet fleet = VehicleFactory::createVehicles({"Car", "Truck", "Car", "Bike", "Plane", "Bike"});
+    fleet.forEachDrive();
+    cout << "Fleet: " << fleet.size() << " vehicles in " << fleet.segment<Car>().size() << " cars, "
+         << fleet.segment<Bike>().size() << " bikes, " << fleet.segment<Truck>().size() << " trucks ("
+         << fleet.unknownCount() << " unknown); compare with: " << argv[0] << " --bench-fleet" << endl;
     
     cout << "\n=== Key Advantages ===" << endl;
     cout << "1. Client doesn't need to know concrete classes" << endl;
     cout << "2. Easy to add new vehicle types" << endl;
     cout << "3. Centralized object creation" << endl;
-    cout << "4. Follows Open/Closed Principle" << endl;
+    cout << "4. Follows Open/Closed Principle (products self-register)" << endl;
+
+    // Only with -DFACTORY_INSTRUMENTATION; otherwise compiled out
+    FACTORY_DUMP_JSON(cout);
     
     return 0;
 }
@@ -29,9 +29,257 @@ Use Cases:
 #include <thread>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <variant>
+#include <optional>
+#include <unordered_map>
+#include <fstream>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <list>
+#include <map>
+#include <cctype>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
+// ========================================================================
+// PREPARED STATEMENT CACHE (used by every connection below)
+// ========================================================================
+// Queries that differ only in their literals share one parsed/planned
+// statement: the SQL is normalized (case, whitespace, literals -> ?),
+// hashed, and looked up in a small per-connection LRU. A hit skips
+// parsing and planning and just binds the extracted literals by position.
+
+// Quotes a value for binding as a string parameter.
+string sqlQuote(const string& value) {
+    string quoted = "'";
+    for (char c : value) {
+        if (c == '\'') quoted += '\'';
+        quoted += c;
+    }
+    return quoted + "'";
+}
+
+// Lowercases keywords/identifiers, collapses whitespace and replaces
+// numeric and quoted string literals with '?', appending their SQL text
+// to literals in order. A '?' already in the SQL appends an empty slot for
+// the caller's parameter. Double-quoted identifiers are kept verbatim.
+string normalizeSql(const string& sql, vector<string>& literals) {
+    string out;
+    out.reserve(sql.size());
+    bool pendingSpace = false;
+    for (size_t i = 0; i < sql.size();) {
+        char c = sql[i];
+        if (isspace((unsigned char)c)) {
+            pendingSpace = !out.empty();
+            i++;
+            continue;
+        }
+        if (pendingSpace) {
+            out += ' ';
+            pendingSpace = false;
+        }
+        bool afterIdentifier = !out.empty() && (isalnum((unsigned char)out.back()) || out.back() == '_');
+        if (c == '\'' || c == '"') {
+            size_t end = i + 1;
+            while (end < sql.size()) {
+                if (sql[end] == c && end + 1 < sql.size() && sql[end + 1] == c) {
+                    end += 2;  // escaped quote
+                } else if (sql[end] == c) {
+                    break;
+                } else {
+                    end++;
+                }
+            }
+            end = min(end + 1, sql.size());
+            if (c == '\'') {
+                literals.push_back(sql.substr(i, end - i));
+                out += '?';
+            } else {
+                out.append(sql, i, end - i);
+            }
+            i = end;
+        } else if (c == '?') {
+            literals.push_back("");
+            out += '?';
+            i++;
+        } else if (isdigit((unsigned char)c) && !afterIdentifier) {
+            size_t end = i;
+            while (end < sql.size() && (isalnum((unsigned char)sql[end]) || sql[end] == '.')) end++;
+            literals.push_back(sql.substr(i, end - i));
+            out += '?';
+            i = end;
+        } else {
+            out += (char)tolower((unsigned char)c);
+            i++;
+        }
+    }
+    return out;
+}
+
+// What a parse + plan produces. Immutable once cached.
+struct PreparedStatement {
+    string text;                  // normalized SQL with '?' placeholders
+    uint64_t hash;
+    vector<string> tokens;
+    vector<size_t> placeholders;  // token index of each '?', in order
+    string plan;
+    uint64_t parseNanos;          // what a cache hit saves
+};
+
+struct StatementCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t parseNanos;      // spent parsing misses
+    uint64_t parseNanosSaved; // parse cost of the hits, measured on their miss
+    double hitRatio;
+};
+
+// One per connection; a connection is used by one thread at a time so
+// the cache needs no lock. Counters are atomic only so a pool can sum them
+// while connections are checked out.
+class StatementCache {
+private:
+    size_t capacity;
+    list<shared_ptr<const PreparedStatement>> lru;  // front = most recent
+    unordered_map<uint64_t, list<shared_ptr<const PreparedStatement>>::iterator> byHash;
+    atomic<uint64_t> hits{0}, misses{0}, evictions{0}, parseNanos{0}, parseNanosSaved{0};
+
+    static void bump(atomic<uint64_t>& counter, uint64_t by = 1) {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);  // single writer
+    }
+
+    static uint64_t hashText(const string& text) {
+        uint64_t hash = 1469598103934665603ULL;
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static shared_ptr<const PreparedStatement> parse(const string& text, uint64_t hash) {
+        auto start = chrono::steady_clock::now();
+        auto statement = make_shared<PreparedStatement>();
+        statement->text = text;
+        statement->hash = hash;
+        for (size_t i = 0; i < text.size();) {
+            if (text[i] == ' ') {
+                i++;
+            } else if (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '"') {
+                size_t end = i + 1;
+                while (end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_' || text[end] == '.' || text[end] == '"')) end++;
+                statement->tokens.push_back(text.substr(i, end - i));
+                i = end;
+            } else {
+                if (text[i] == '?') statement->placeholders.push_back(statement->tokens.size());
+                statement->tokens.push_back(string(1, text[i]));
+                i++;
+            }
+        }
+
+        // Toy planner: the statement kind, its table and whether an
+        // equality on a bound column allows an index lookup.
+        const vector<string>& t = statement->tokens;
+        string kind = t.empty() ? "empty" : t[0];
+        string table, indexColumn;
+        for (size_t i = 0; i + 1 < t.size(); i++) {
+            if (table.empty() && (t[i] == "from" || t[i] == "into" || t[i] == "update")) table = t[i + 1];
+            if (indexColumn.empty() && t[i] == "where" && i + 3 < t.size() && t[i + 2] == "=" && t[i + 3] == "?") {
+                indexColumn = t[i + 1];
+            }
+        }
+        statement->plan = kind + " " + table + (indexColumn.empty() ? " (scan)" : " (index on " + indexColumn + ")");
+        statement->parseNanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        return statement;
+    }
+
+public:
+    StatementCache(size_t capacity = 64) : capacity(max<size_t>(capacity, 1)) {}
+
+    // Takes normalized SQL (see normalizeSql).
+    shared_ptr<const PreparedStatement> prepare(const string& text) {
+        uint64_t hash = hashText(text);
+        auto it = byHash.find(hash);
+        if (it != byHash.end() && (*it->second)->text == text) {
+            lru.splice(lru.begin(), lru, it->second);
+            bump(hits);
+            bump(parseNanosSaved, (*it->second)->parseNanos);
+            return *it->second;
+        }
+        bump(misses);
+        shared_ptr<const PreparedStatement> statement = parse(text, hash);
+        bump(parseNanos, statement->parseNanos);
+        if (it != byHash.end()) {
+            // Hash collision: the newer statement takes the slot.
+            lru.erase(it->second);
+            byHash.erase(it);
+        }
+        if (lru.size() >= capacity) {
+            byHash.erase(lru.back()->hash);
+            lru.pop_back();
+            bump(evictions);
+        }
+        lru.push_front(statement);
+        byHash[hash] = lru.begin();
+        return statement;
+    }
+
+    // Substitutes params (SQL literal text) for the placeholders by position.
+    static string bind(const PreparedStatement& statement, const vector<string>& params) {
+        if (params.size() != statement.placeholders.size()) {
+            throw invalid_argument("expected " + to_string(statement.placeholders.size()) + " parameters, got " + to_string(params.size()));
+        }
+        string sql;
+        size_t next = 0;
+        for (size_t i = 0; i < statement.tokens.size(); i++) {
+            if (i > 0) sql += ' ';
+            sql += next < params.size() && statement.placeholders[next] == i ? params[next++] : statement.tokens[i];
+        }
+        return sql;
+    }
+
+    StatementCacheStats stats() const {
+        StatementCacheStats s;
+        s.hits = hits.load(memory_order_relaxed);
+        s.misses = misses.load(memory_order_relaxed);
+        s.evictions = evictions.load(memory_order_relaxed);
+        s.parseNanos = parseNanos.load(memory_order_relaxed);
+        s.parseNanosSaved = parseNanosSaved.load(memory_order_relaxed);
+        s.hitRatio = s.hits + s.misses ? double(s.hits) / (s.hits + s.misses) : 0;
+        return s;
+    }
+};
+
+StatementCacheStats& operator+=(StatementCacheStats& total, const StatementCacheStats& s) {
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.evictions += s.evictions;
+    total.parseNanos += s.parseNanos;
+    total.parseNanosSaved += s.parseNanosSaved;
+    total.hitRatio = total.hits + total.misses ? double(total.hits) / (total.hits + total.misses) : 0;
+    return total;
+}
+
 // ========================================================================
 // 1. LAZY INITIALIZATION SINGLETON (Not Thread-Safe)
 // ========================================================================
@@ -39,6 +287,7 @@ class LazyDatabaseConnection {
 private:
     static LazyDatabaseConnection* instance;
     string connectionString;
+    StatementCache statements;
     
     // Private constructor
     LazyDatabaseConnection() {
@@ -47,29 +296,1089 @@ private:
     }
     
 public:
-    // Delete copy constructor and assignment operator
-    LazyDatabaseConnection(const LazyDatabaseConnection&) = delete;
-    LazyDatabaseConnection& operator=(const LazyDatabaseConnection&) = delete;
-    
-    // Static method to get instance
-    static LazyDatabaseConnection* getInstance() {
-        if (instance == nullptr) {
-            instance = new LazyDatabaseConnection();
+    // Delete copy constructor and assignment operator
+    LazyDatabaseConnection(const LazyDatabaseConnection&) = delete;
+    LazyDatabaseConnection& operator=(const LazyDatabaseConnection&) = delete;
+    
+    // Static method to get instance
+    static LazyDatabaseConnection* getInstance() {
+        if (instance == nullptr) {
+            instance = new LazyDatabaseConnection();
+        }
+        return instance;
+    }
+    
+    void query(const string& sql) {
+        vector<string> literals;
+        shared_ptr<const PreparedStatement> statement = statements.prepare(normalizeSql(sql, literals));
+        cout << "Executing query: " << StatementCache::bind(*statement, literals)
+             << "  [plan: " << statement->plan << "]" << endl;
+    }
+
+    // sql may use '?' placeholders, bound by position; quote text with sqlQuote().
+    void execute(const string& sql, const vector<string>& params) {
+        vector<string> values;
+        shared_ptr<const PreparedStatement> statement = statements.prepare(normalizeSql(sql, values));
+        size_t next = 0;
+        for (string& value : values) {
+            if (value.empty() && next < params.size()) value = params[next++];
+        }
+        cout << "Executing query: " << StatementCache::bind(*statement, values) << endl;
+    }
+
+    StatementCacheStats statementStats() const {
+        return statements.stats();
+    }
+    
+    string getConnection() {
+        return connectionString;
+    }
+};
+
+// Initialize static member
+LazyDatabaseConnection* LazyDatabaseConnection::instance = nullptr;
+
+// ========================================================================
+// CONNECTION POOL (replaces sharing one LazyDatabaseConnection)
+// ========================================================================
+// A single lazily created connection cannot serve concurrent queries.
+// The pool below keeps up to maxSize connections, warms minIdle of them
+// at startup and hands them out per query:
+//   - fast path: each thread first retries the connections it used last
+//     (thread-local list, claimed with a CAS, no lock at all);
+//   - slow path: scan the shared list, open a new connection if under
+//     maxSize, otherwise wait up to checkoutTimeout;
+//   - connections idle for a while are pinged before reuse, and a
+//     maintenance thread evicts long-idle ones down to minIdle.
+
+// In-process stand-in for a database server so the pool can be exercised
+// offline. Every call costs a configurable latency; dropAllConnections()
+// simulates a server restart that breaks every open session.
+class FakeDatabaseServer {
+private:
+    chrono::microseconds queryLatency;
+    chrono::microseconds connectLatency;
+    atomic<uint64_t> generation{1};
+    atomic<uint64_t> queries{0};
+
+public:
+    FakeDatabaseServer(chrono::microseconds queryLatency, chrono::microseconds connectLatency)
+        : queryLatency(queryLatency), connectLatency(connectLatency) {}
+
+    // Returns a session token.
+    uint64_t connect() {
+        this_thread::sleep_for(connectLatency);
+        return generation.load();
+    }
+
+    bool execute(uint64_t session, const string& sql, string& result) {
+        this_thread::sleep_for(queryLatency);
+        if (session != generation.load()) return false;
+        queries.fetch_add(1, memory_order_relaxed);
+        result = "OK: " + sql;
+        return true;
+    }
+
+    bool ping(uint64_t session) {
+        return session == generation.load();
+    }
+
+    void dropAllConnections() {
+        generation.fetch_add(1);
+    }
+
+    uint64_t queryCount() const {
+        return queries.load();
+    }
+};
+
+class DatabaseConnection {
+private:
+    FakeDatabaseServer& server;
+    uint64_t session;
+    StatementCache statements;
+
+public:
+    DatabaseConnection(FakeDatabaseServer& server) : server(server) {
+        session = server.connect();
+    }
+
+    bool query(const string& sql, string& result) {
+        vector<string> literals;
+        shared_ptr<const PreparedStatement> statement = statements.prepare(normalizeSql(sql, literals));
+        return server.execute(session, StatementCache::bind(*statement, literals), result);
+    }
+
+    StatementCacheStats statementStats() const {
+        return statements.stats();
+    }
+
+    bool isAlive() {
+        return server.ping(session);
+    }
+};
+
+struct ConnectionPoolOptions {
+    size_t minIdle = 2;
+    size_t maxSize = 8;
+    chrono::milliseconds checkoutTimeout{250};
+    chrono::milliseconds validateAfterIdle{500};  // ping before reuse after this long
+    chrono::milliseconds idleTimeout{10000};      // evict above minIdle after this long
+    chrono::milliseconds maintenanceInterval{1000};
+};
+
+struct ConnectionPoolStats {
+    uint64_t checkouts;
+    uint64_t timeouts;
+    uint64_t created;
+    uint64_t evicted;
+    uint64_t failedHealthChecks;
+    double averageWaitMicros;
+    double maxWaitMicros;
+    size_t total;
+    size_t inUse;
+    double utilization;  // inUse / maxSize
+    StatementCacheStats statements;  // over every connection the pool has opened, closed ones included
+};
+
+class ConnectionPool {
+private:
+    enum { kIdle = 0, kInUse = 1, kRemoved = 2 };
+
+    struct Entry {
+        unique_ptr<DatabaseConnection> connection;
+        atomic<int> state{kInUse};
+        atomic<int64_t> lastUsedNs{0};
+    };
+
+    // Connections this thread used recently, per pool.
+    struct ThreadAffinity {
+        vector<pair<uint64_t, vector<weak_ptr<Entry>>>> pools;
+    };
+    static thread_local ThreadAffinity affinity;
+    static atomic<uint64_t> nextPoolId;
+    static constexpr size_t kAffinityEntries = 4;
+
+    uint64_t id;
+    FakeDatabaseServer& server;
+    ConnectionPoolOptions options;
+
+    mutex mtx;
+    condition_variable released;
+    vector<shared_ptr<Entry>> entries;
+    StatementCacheStats retiredStatements = StatementCacheStats();  // from connections no longer in entries
+    size_t opening = 0;  // connections being opened outside the lock
+    atomic<int> waiters{0};
+    atomic<size_t> inUse{0};
+
+    atomic<uint64_t> checkouts{0}, timeouts{0}, created{0}, evicted{0}, failedHealthChecks{0};
+    atomic<uint64_t> totalWaitNs{0}, maxWaitNs{0};
+
+    bool stopping = false;
+    condition_variable stopCv;
+    thread maintenance;
+
+    static int64_t nowNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    vector<weak_ptr<Entry>>& recentEntries() {
+        for (auto& pool : affinity.pools) {
+            if (pool.first == id) return pool.second;
+        }
+        affinity.pools.push_back({id, {}});
+        return affinity.pools.back().second;
+    }
+
+    // Caller owns entry (state kInUse). False if the connection is dead
+    // and has been removed.
+    bool validate(const shared_ptr<Entry>& entry) {
+        int64_t idleNs = nowNs() - entry->lastUsedNs.load(memory_order_relaxed);
+        if (idleNs < chrono::duration_cast<chrono::nanoseconds>(options.validateAfterIdle).count()
+            || entry->connection->isAlive()) {
+            return true;
+        }
+        failedHealthChecks.fetch_add(1, memory_order_relaxed);
+        remove(entry);
+        return false;
+    }
+
+    void remove(const shared_ptr<Entry>& entry) {
+        entry->state.store(kRemoved);
+        lock_guard<mutex> lock(mtx);
+        retiredStatements += entry->connection->statementStats();
+        entries.erase(std::remove(entries.begin(), entries.end(), entry), entries.end());
+        released.notify_one();  // a slot under maxSize just opened up
+    }
+
+    shared_ptr<Entry> tryClaim(const shared_ptr<Entry>& entry) {
+        int expected = kIdle;
+        if (entry && entry->state.compare_exchange_strong(expected, kInUse)) return entry;
+        return nullptr;
+    }
+
+    shared_ptr<Entry> open() {
+        auto entry = make_shared<Entry>();
+        entry->connection = make_unique<DatabaseConnection>(server);
+        entry->lastUsedNs.store(nowNs());
+        created.fetch_add(1, memory_order_relaxed);
+        return entry;
+    }
+
+    // Called with lock held; drops it around open() and keeps the
+    // opening count balanced even when open() throws.
+    shared_ptr<Entry> openUnlocked(unique_lock<mutex>& lock) {
+        opening++;
+        lock.unlock();
+        shared_ptr<Entry> entry;
+        try {
+            entry = open();
+        } catch (...) {
+            lock.lock();
+            opening--;
+            released.notify_one();  // the slot we reserved is free again
+            throw;
+        }
+        lock.lock();
+        opening--;
+        return entry;
+    }
+
+    shared_ptr<Entry> acquire() {
+        // 1. Lock-free: connections this thread used last.
+        vector<weak_ptr<Entry>>& recent = recentEntries();
+        for (auto it = recent.rbegin(); it != recent.rend(); ++it) {
+            if (shared_ptr<Entry> entry = tryClaim(it->lock())) return entry;
+        }
+
+        // 2. Shared list, then a new connection, then wait. We count
+        // ourselves as a waiter before scanning: release() publishes kIdle
+        // and then reads waiters (both seq_cst), so either our scan sees
+        // the idle entry or release() sees us and notifies under mtx,
+        // which we hold from the scan until wait_until() parks us.
+        auto deadline = chrono::steady_clock::now() + options.checkoutTimeout;
+        unique_lock<mutex> lock(mtx);
+        waiters.fetch_add(1);
+        struct WaiterGuard {
+            atomic<int>& waiters;
+            ~WaiterGuard() { waiters.fetch_sub(1); }
+        } guard{waiters};
+        bool timedOut = false;
+        while (true) {
+            for (auto& candidate : entries) {
+                if (shared_ptr<Entry> entry = tryClaim(candidate)) return entry;
+            }
+            if (entries.size() + opening < options.maxSize) {
+                shared_ptr<Entry> entry = openUnlocked(lock);
+                entries.push_back(entry);
+                return entry;
+            }
+            if (timedOut) return nullptr;  // rescanned once after the deadline
+            timedOut = released.wait_until(lock, deadline) == cv_status::timeout;
+        }
+    }
+
+    void release(const shared_ptr<Entry>& entry) {
+        entry->lastUsedNs.store(nowNs(), memory_order_relaxed);
+        inUse.fetch_sub(1, memory_order_relaxed);
+        vector<weak_ptr<Entry>>& recent = recentEntries();
+        recent.erase(remove_if(recent.begin(), recent.end(), [&](const weak_ptr<Entry>& w) {
+            shared_ptr<Entry> e = w.lock();
+            return !e || e == entry;
+        }), recent.end());
+        recent.push_back(entry);
+        if (recent.size() > kAffinityEntries) recent.erase(recent.begin());
+
+        // seq_cst store then load; see acquire() for the other half.
+        entry->state.store(kIdle);
+        if (waiters.load() > 0) {
+            lock_guard<mutex> lock(mtx);  // a waiter past its scan is parked or about to be
+            released.notify_one();
+        }
+    }
+
+    void maintain() {
+        unique_lock<mutex> lock(mtx);
+        while (!stopping) {
+            stopCv.wait_for(lock, options.maintenanceInterval);
+            if (stopping) break;
+            int64_t cutoff = nowNs() - chrono::duration_cast<chrono::nanoseconds>(options.idleTimeout).count();
+            for (size_t i = 0; i < entries.size() && entries.size() > options.minIdle;) {
+                int expected = kIdle;
+                if (entries[i]->lastUsedNs.load() < cutoff
+                    && entries[i]->state.compare_exchange_strong(expected, kRemoved)) {
+                    retiredStatements += entries[i]->connection->statementStats();
+                    entries.erase(entries.begin() + i);
+                    evicted.fetch_add(1, memory_order_relaxed);
+                } else {
+                    i++;
+                }
+            }
+            while (entries.size() + opening < options.minIdle) {
+                shared_ptr<Entry> entry = openUnlocked(lock);
+                entry->state.store(kIdle);
+                entries.push_back(entry);
+                released.notify_one();  // a waiter may have counted this slot as taken
+            }
+        }
+    }
+
+public:
+    // RAII checkout; the connection goes back to the pool on destruction.
+    class Handle {
+    private:
+        ConnectionPool* pool = nullptr;
+        shared_ptr<Entry> entry;
+
+    public:
+        Handle() {}
+        Handle(ConnectionPool* pool, shared_ptr<Entry> entry) : pool(pool), entry(entry) {}
+        Handle(Handle&& other) noexcept : pool(other.pool), entry(move(other.entry)) {}
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        ~Handle() {
+            if (entry) pool->release(entry);
+        }
+
+        explicit operator bool() const { return entry != nullptr; }
+        DatabaseConnection* operator->() const { return entry->connection.get(); }
+    };
+
+    // Warms up minIdle connections before returning.
+    ConnectionPool(FakeDatabaseServer& server, ConnectionPoolOptions options = ConnectionPoolOptions())
+        : id(nextPoolId.fetch_add(1)), server(server), options(options) {
+        this->options.minIdle = min(options.minIdle, options.maxSize);
+        for (size_t i = 0; i < this->options.minIdle; i++) {
+            shared_ptr<Entry> entry = open();
+            entry->state.store(kIdle);
+            entries.push_back(entry);
+        }
+        maintenance = thread(&ConnectionPool::maintain, this);
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // All handles must have been returned.
+    ~ConnectionPool() {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        stopCv.notify_all();
+        maintenance.join();
+    }
+
+    // Empty handle when no connection frees up within checkoutTimeout.
+    Handle checkout() {
+        auto start = chrono::steady_clock::now();
+        shared_ptr<Entry> entry;
+        do {
+            entry = acquire();
+        } while (entry && !validate(entry));
+
+        uint64_t waitNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        totalWaitNs.fetch_add(waitNs, memory_order_relaxed);
+        uint64_t previousMax = maxWaitNs.load(memory_order_relaxed);
+        while (waitNs > previousMax && !maxWaitNs.compare_exchange_weak(previousMax, waitNs)) {
+        }
+        if (!entry) {
+            timeouts.fetch_add(1, memory_order_relaxed);
+            return Handle();
+        }
+        checkouts.fetch_add(1, memory_order_relaxed);
+        inUse.fetch_add(1, memory_order_relaxed);
+        return Handle(this, entry);
+    }
+
+    ConnectionPoolStats stats() {
+        ConnectionPoolStats s;
+        s.checkouts = checkouts.load();
+        s.timeouts = timeouts.load();
+        s.created = created.load();
+        s.evicted = evicted.load();
+        s.failedHealthChecks = failedHealthChecks.load();
+        uint64_t attempts = s.checkouts + s.timeouts;
+        s.averageWaitMicros = attempts ? totalWaitNs.load() / 1000.0 / attempts : 0;
+        s.maxWaitMicros = maxWaitNs.load() / 1000.0;
+        {
+            lock_guard<mutex> lock(mtx);
+            s.statements = retiredStatements;
+            s.total = entries.size();
+            for (auto& entry : entries) {
+                s.statements += entry->connection->statementStats();
+            }
+        }
+        s.inUse = inUse.load();
+        s.utilization = double(s.inUse) / options.maxSize;
+        return s;
+    }
+};
+
+thread_local ConnectionPool::ThreadAffinity ConnectionPool::affinity;
+atomic<uint64_t> ConnectionPool::nextPoolId(1);
+
+
+// ========================================================================
+// ASYNC LOG BACKEND behind EagerLogger
+// ========================================================================
+// Each logging thread owns a lock-free single-producer/single-consumer
+// ring of fixed-size records. log() only stamps a raw TSC timestamp and
+// copies the message into the next free slot; a background flusher drains
+// all rings, formats the lines and writes them to a rotating file with one
+// writev() per batch. When a ring is full the overflow policy decides
+// between dropping the record (counted) and waiting for space.
+
+// Cheap timestamps: raw TSC ticks on x86-64 (a few ns), converted to wall
+// time only on the flusher side. Other CPUs use CLOCK_MONOTONIC_COARSE.
+class CheapClock {
+private:
+    uint64_t baseTicks = 0;
+    int64_t baseWallNs = 0;
+    double nsPerTick = 1.0;
+
+    static int64_t wallNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+    }
+
+    // Measures the tick rate against the system clock for ~10ms.
+    void calibrate() {
+        baseWallNs = wallNs();
+        baseTicks = ticks();
+#if defined(__x86_64__) || defined(__i386__)
+        this_thread::sleep_for(chrono::milliseconds(10));
+        nsPerTick = double(wallNs() - baseWallNs) / double(ticks() - baseTicks);
+#endif
+    }
+
+    int64_t toWallNs(uint64_t tick) const {
+        return baseWallNs + (int64_t)((double)(int64_t)(tick - baseTicks) * nsPerTick);
+    }
+};
+
+struct LogRecord {
+    static constexpr size_t kPayloadBytes = 240;
+    uint64_t ticks;
+    uint32_t siteId;  // 0 = preformatted text
+    uint32_t length;
+    char payload[kPayloadBytes];
+};
+
+// ------------------------------------------------------------------------
+// Structured logging: compile-time checked formats, binary arguments
+//
+//   LOG_INFO("user {} logged in after {} ms", userId, elapsed);
+//
+// The format string is parsed at compile time (placeholder count and
+// offsets) and a mismatch with the argument count is a compile error.
+// Each call site registers itself once and gets a numeric id; at run time
+// only that id and the raw argument bytes are copied into the log ring.
+// Text is produced by the background flusher, or not at all when the
+// logger writes a binary file (decode it offline with --decode <file>).
+// Levels below LOG_COMPILE_LEVEL are discarded by `if constexpr` and
+// generate no code, although their formats are still checked.
+// ------------------------------------------------------------------------
+enum LogLevel { LOG_LEVEL_TRACE = 0, LOG_LEVEL_DEBUG, LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR };
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+static const char* logLevelName(int level) {
+    static const char* names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+    return (level >= 0 && level <= LOG_LEVEL_ERROR) ? names[level] : "?";
+}
+
+constexpr size_t countPlaceholders(const char* format) {
+    size_t count = 0;
+    for (size_t i = 0; format[i] != '\0'; i++) {
+        if (format[i] == '{' && format[i + 1] == '}') {
+            count++;
+            i++;
+        }
+    }
+    return count;
+}
+
+template <size_t N>
+struct FormatSpec {
+    static constexpr size_t count = N;
+    size_t offsets[N > 0 ? N : 1] = {};  // position of each "{}"
+};
+
+template <size_t N>
+constexpr FormatSpec<N> parseFormat(const char* format) {
+    FormatSpec<N> spec{};
+    size_t k = 0;
+    for (size_t i = 0; format[i] != '\0' && k < N; i++) {
+        if (format[i] == '{' && format[i + 1] == '}') {
+            spec.offsets[k++] = i;
+            i++;
+        }
+    }
+    return spec;
+}
+
+struct LogSite {
+    int level;
+    const char* file;
+    int line;
+    const char* format;
+    const size_t* offsets;
+    size_t count;
+};
+
+// Call sites by id, readable without locks from the flusher.
+class LogSites {
+private:
+    static constexpr uint32_t kMaxSites = 1 << 16;
+    static atomic<const LogSite*> table[kMaxSites];
+    static atomic<uint32_t> nextId;
+
+public:
+    static uint32_t add(const LogSite& site) {
+        uint32_t id = nextId.fetch_add(1);
+        if (id >= kMaxSites) return 0;  // out of ids: the call site logs nothing useful
+        table[id].store(new LogSite(site), memory_order_release);
+        return id;
+    }
+
+    static const LogSite* get(uint32_t id) {
+        return id < kMaxSites ? table[id].load(memory_order_acquire) : nullptr;
+    }
+};
+
+atomic<const LogSite*> LogSites::table[LogSites::kMaxSites];
+atomic<uint32_t> LogSites::nextId(1);  // 0 = plain text record
+
+// Argument encoding: one type tag byte followed by the raw value.
+// Strings are length-prefixed and cut to what fits in the record.
+class LogArgs {
+private:
+    template <typename T>
+    static bool putRaw(char*& p, char* end, char tag, T value) {
+        if (end - p < (ptrdiff_t)(1 + sizeof(T))) return false;
+        *p++ = tag;
+        memcpy(p, &value, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    static bool putString(char*& p, char* end, const char* text, size_t length) {
+        if (end - p < 3) return false;
+        uint16_t n = (uint16_t)min<size_t>(length, end - p - 3);
+        *p++ = 's';
+        memcpy(p, &n, 2);
+        memcpy(p + 2, text, n);
+        p += 2 + n;
+        return true;
+    }
+
+    template <typename T>
+    static bool put(char*& p, char* end, const T& value) {
+        typedef typename decay<T>::type Type;
+        if constexpr (is_same<Type, bool>::value) {
+            return putRaw(p, end, 'b', (uint8_t)value);
+        } else if constexpr (is_same<Type, char>::value) {
+            return putRaw(p, end, 'c', value);
+        } else if constexpr (is_integral<Type>::value && is_signed<Type>::value) {
+            return putRaw(p, end, 'i', (int64_t)value);
+        } else if constexpr (is_integral<Type>::value) {
+            return putRaw(p, end, 'u', (uint64_t)value);
+        } else if constexpr (is_floating_point<Type>::value) {
+            return putRaw(p, end, 'd', (double)value);
+        } else if constexpr (is_same<Type, string>::value) {
+            return putString(p, end, value.data(), value.size());
+        } else {
+            static_assert(is_convertible<Type, const char*>::value, "unsupported log argument type");
+            const char* text = value;
+            return putString(p, end, text ? text : "(null)", text ? strlen(text) : 6);
+        }
+    }
+
+public:
+    // Returns the number of bytes used.
+    template <typename... Args>
+    static size_t encode(char* buffer, size_t capacity, const Args&... args) {
+        char* p = buffer;
+        char* end = buffer + capacity;
+        bool fits = true;
+        ((fits = fits && put(p, end, args)), ...);
+        return p - buffer;
+    }
+
+    // Appends the text of the next argument; false at end of data. The
+    // payload may come from a damaged file, so every read is checked and a
+    // short or unknown argument ends decoding (p is moved to end).
+    static bool decodeNext(const char*& p, const char* end, string& out) {
+        if (p >= end) return false;
+        char tag = *p++;
+        auto fits = [&](size_t n) {
+            if ((size_t)(end - p) >= n) return true;
+            p = end;
+            return false;
+        };
+        char text[32];
+        switch (tag) {
+            case 'b': { if (!fits(1)) return false; uint8_t v; memcpy(&v, p, 1); p += 1; out += v ? "true" : "false"; return true; }
+            case 'c': { if (!fits(1)) return false; out += *p; p += 1; return true; }
+            case 'i': { if (!fits(8)) return false; int64_t v; memcpy(&v, p, 8); p += 8; snprintf(text, sizeof(text), "%lld", (long long)v); break; }
+            case 'u': { if (!fits(8)) return false; uint64_t v; memcpy(&v, p, 8); p += 8; snprintf(text, sizeof(text), "%llu", (unsigned long long)v); break; }
+            case 'd': { if (!fits(8)) return false; double v; memcpy(&v, p, 8); p += 8; snprintf(text, sizeof(text), "%g", v); break; }
+            case 's': {
+                if (!fits(2)) return false;
+                uint16_t n;
+                memcpy(&n, p, 2);
+                p += 2;
+                if (!fits(n)) return false;
+                out.append(p, n);
+                p += n;
+                return true;
+            }
+            default: p = end; return false;
+        }
+        out += text;
+        return true;
+    }
+
+    // Splices the decoded arguments into the format at the given offsets.
+    static void format(const char* format, const size_t* offsets, size_t count,
+                       const char* payload, size_t length, string& out) {
+        const char* p = payload;
+        const char* end = payload + length;
+        size_t position = 0;
+        for (size_t i = 0; i < count; i++) {
+            out.append(format + position, offsets[i] - position);
+            if (!decodeNext(p, end, out)) out += "{?}";
+            position = offsets[i] + 2;
+        }
+        out += format + position;
+    }
+};
+
+// Bounded SPSC ring. head and tail live on separate cache lines, and the
+// producer caches the consumer's head so a push normally touches no line
+// the flusher writes.
+class LogRing {
+private:
+    vector<LogRecord> slots;
+    size_t mask;
+    alignas(64) atomic<uint64_t> head{0};  // next slot to read (flusher)
+    alignas(64) atomic<uint64_t> tail{0};  // next slot to write (owner thread)
+    uint64_t cachedHead = 0;
+
+public:
+    LogRing(size_t capacityPowerOfTwo) : slots(capacityPowerOfTwo), mask(capacityPowerOfTwo - 1) {}
+
+    // Returns the slot to fill, or nullptr if the ring is full.
+    LogRecord* beginPush() {
+        uint64_t t = tail.load(memory_order_relaxed);
+        if (t - cachedHead >= slots.size()) {
+            cachedHead = head.load(memory_order_acquire);
+            if (t - cachedHead >= slots.size()) return nullptr;
+        }
+        return &slots[t & mask];
+    }
+
+    void commitPush() {
+        tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    // Flusher side: hands every readable record to visit, then frees them.
+    template <typename F>
+    size_t drain(F visit) {
+        uint64_t h = head.load(memory_order_relaxed);
+        uint64_t t = tail.load(memory_order_acquire);
+        for (uint64_t i = h; i < t; i++) {
+            visit(slots[i & mask]);
+        }
+        head.store(t, memory_order_release);
+        return t - h;
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+};
+
+enum class OverflowPolicy { Drop, Block };
+
+// Binary files start with "BLOG1\n" and hold three kinds of entries:
+//   'S' site:    [u32 id][u8 level][u32 line][u16 n][file][u16 n][format]
+//   'R' record:  [i64 wall ns][u32 site id][u16 n][argument bytes or text]
+//   'N' session: no body; site ids defined before it no longer apply
+// A site is written before its first record in every file. Site ids are
+// assigned per process, so appending to an existing file starts with 'N'.
+enum class LogFileFormat { Text, Binary };
+
+class AsyncLogger {
+private:
+    struct ThreadBuffer {
+        LogRing ring;
+        atomic<bool> threadExited{false};
+        ThreadBuffer(size_t capacity) : ring(capacity) {}
+    };
+
+    // Per-thread registration, keyed by logger id so a destroyed logger's
+    // address being reused cannot hand out a stale buffer.
+    struct ThreadRegistration {
+        vector<pair<uint64_t, shared_ptr<ThreadBuffer>>> buffers;
+        ~ThreadRegistration() {
+            for (auto& entry : buffers) entry.second->threadExited.store(true, memory_order_release);
+        }
+    };
+    static thread_local ThreadRegistration registration;
+    static atomic<uint64_t> nextLoggerId;
+
+    uint64_t id;
+    string path;
+    size_t ringCapacity;
+    size_t maxFileBytes;
+    int keepFiles;
+    OverflowPolicy policy;
+    LogFileFormat fileFormat;
+    CheapClock clock;
+    vector<bool> sitesInFile;  // binary mode: site definitions already written
+
+    mutex registryMtx;
+    vector<shared_ptr<ThreadBuffer>> buffers;
+    atomic<uint64_t> dropped{0};
+    atomic<uint64_t> flushedGeneration{0};
+    atomic<bool> stopping{false};
+    int fd = -1;
+    size_t fileBytes = 0;
+    thread flusher;
+
+    ThreadBuffer& myBuffer() {
+        for (auto& entry : registration.buffers) {
+            if (entry.first == id) return *entry.second;
+        }
+        auto buffer = make_shared<ThreadBuffer>(ringCapacity);
+        {
+            lock_guard<mutex> lock(registryMtx);
+            buffers.push_back(buffer);
+        }
+        registration.buffers.push_back({id, buffer});
+        return *buffer;
+    }
+
+    void openFile() {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        struct stat info = {};
+        fileBytes = (fd >= 0 && ::fstat(fd, &info) == 0) ? info.st_size : 0;
+        sitesInFile.clear();
+        if (fd >= 0 && fileFormat == LogFileFormat::Binary) {
+            if (fileBytes == 0) {
+                fileBytes = ::write(fd, "BLOG1\n", 6) == 6 ? 6 : 0;
+            } else if (::write(fd, "N", 1) == 1) {
+                fileBytes++;
+            }
+        }
+    }
+
+    // path -> path.1 -> path.2 ... ; the oldest beyond keepFiles is dropped.
+    void rotate() {
+        ::close(fd);
+        for (int i = keepFiles - 1; i >= 1; i--) {
+            ::rename((path + "." + to_string(i)).c_str(), (path + "." + to_string(i + 1)).c_str());
+        }
+        ::rename(path.c_str(), (path + ".1").c_str());
+        openFile();
+    }
+
+    void appendLine(string& chunk, const LogRecord& record) {
+        int64_t wall = clock.toWallNs(record.ticks);
+        time_t seconds = wall / 1000000000;
+        tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        size_t n = strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+        snprintf(stamp + n, sizeof(stamp) - n, ".%06lld ", (long long)(wall % 1000000000) / 1000);
+        chunk += stamp;
+        const LogSite* site = record.siteId ? LogSites::get(record.siteId) : nullptr;
+        if (site) {
+            chunk += '[';
+            chunk += logLevelName(site->level);
+            chunk += "] ";
+            LogArgs::format(site->format, site->offsets, site->count, record.payload, record.length, chunk);
+        } else {
+            chunk.append(record.payload, record.length);
+        }
+        chunk += '\n';
+    }
+
+    template <typename T>
+    static void appendRaw(string& chunk, T value) {
+        chunk.append((const char*)&value, sizeof(T));
+    }
+
+    static void appendShortString(string& chunk, const char* text, size_t length) {
+        uint16_t n = (uint16_t)min<size_t>(length, 0xffff);
+        appendRaw(chunk, n);
+        chunk.append(text, n);
+    }
+
+    void appendBinary(string& chunk, const LogRecord& record) {
+        const LogSite* site = record.siteId ? LogSites::get(record.siteId) : nullptr;
+        if (site) {
+            if (sitesInFile.size() <= record.siteId) sitesInFile.resize(record.siteId + 1);
+            if (!sitesInFile[record.siteId]) {
+                sitesInFile[record.siteId] = true;
+                chunk += 'S';
+                appendRaw(chunk, record.siteId);
+                appendRaw(chunk, (uint8_t)site->level);
+                appendRaw(chunk, (uint32_t)site->line);
+                appendShortString(chunk, site->file, strlen(site->file));
+                appendShortString(chunk, site->format, strlen(site->format));
+            }
+        }
+        chunk += 'R';
+        appendRaw(chunk, (int64_t)clock.toWallNs(record.ticks));
+        appendRaw(chunk, site ? record.siteId : 0u);
+        appendShortString(chunk, record.payload, record.length);
+    }
+
+    void writeChunks(vector<string>& chunks) {
+        size_t start = 0;
+        while (start < chunks.size()) {
+            vector<iovec> iov;
+            size_t bytes = 0;
+            for (size_t i = start; i < chunks.size() && iov.size() < IOV_MAX; i++) {
+                iov.push_back({(void*)chunks[i].data(), chunks[i].size()});
+                bytes += chunks[i].size();
+            }
+            if (fd >= 0 && ::writev(fd, iov.data(), iov.size()) < 0) {
+                cerr << "AsyncLogger: write to " << path << " failed" << endl;
+            }
+            start += iov.size();
+            fileBytes += bytes;
+        }
+        // Only between batches, so a binary record never lands in a
+        // different file than its site definition.
+        if (fileBytes >= maxFileBytes) rotate();
+    }
+
+    void flushLoop() {
+        vector<string> chunks;
+        while (true) {
+            bool stop = stopping.load(memory_order_acquire);
+            vector<shared_ptr<ThreadBuffer>> snapshot;
+            {
+                lock_guard<mutex> lock(registryMtx);
+                snapshot = buffers;
+            }
+            chunks.clear();
+            size_t records = 0;
+            for (auto& buffer : snapshot) {
+                string chunk;
+                records += buffer->ring.drain([&](const LogRecord& record) {
+                    if (fileFormat == LogFileFormat::Binary) {
+                        appendBinary(chunk, record);
+                    } else {
+                        appendLine(chunk, record);
+                    }
+                });
+                if (!chunk.empty()) chunks.push_back(move(chunk));
+            }
+            writeChunks(chunks);
+            {
+                // Forget buffers whose thread is gone and which are drained.
+                lock_guard<mutex> lock(registryMtx);
+                buffers.erase(remove_if(buffers.begin(), buffers.end(), [](const shared_ptr<ThreadBuffer>& b) {
+                    return b->threadExited.load(memory_order_acquire) && b->ring.empty();
+                }), buffers.end());
+            }
+            flushedGeneration.fetch_add(1, memory_order_release);
+            if (stop) return;
+            if (records == 0) this_thread::sleep_for(chrono::microseconds(500));
+        }
+    }
+
+public:
+    AsyncLogger(string path, size_t ringCapacity = 4096, size_t maxFileBytes = 64 << 20,
+                int keepFiles = 5, OverflowPolicy policy = OverflowPolicy::Drop,
+                LogFileFormat fileFormat = LogFileFormat::Text)
+        : id(nextLoggerId.fetch_add(1)), path(path), maxFileBytes(maxFileBytes),
+          keepFiles(max(1, keepFiles)), policy(policy), fileFormat(fileFormat) {
+        size_t capacity = 1;
+        while (capacity < ringCapacity) capacity <<= 1;
+        this->ringCapacity = capacity;
+        clock.calibrate();
+        openFile();
+        flusher = thread(&AsyncLogger::flushLoop, this);
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    // Writes everything logged before the call, then stops the flusher.
+    ~AsyncLogger() {
+        stopping.store(true, memory_order_release);
+        flusher.join();
+        if (fd >= 0) ::close(fd);
+    }
+
+    // Hot path. fill(record) writes siteId/length/payload into the slot.
+    template <typename Fill>
+    void logRecord(Fill fill) {
+        LogRing& ring = myBuffer().ring;
+        LogRecord* record = ring.beginPush();
+        while (!record) {
+            if (policy == OverflowPolicy::Drop) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+            this_thread::yield();
+            record = ring.beginPush();
         }
-        return instance;
+        record->ticks = CheapClock::ticks();
+        fill(*record);
+        ring.commitPush();
     }
-    
-    void query(const string& sql) {
-        cout << "Executing query: " << sql << endl;
+
+    // Messages longer than a slot are truncated.
+    void log(const char* message, size_t length) {
+        logRecord([message, length](LogRecord& record) {
+            record.siteId = 0;
+            record.length = (uint32_t)min(length, LogRecord::kPayloadBytes);
+            memcpy(record.payload, message, record.length);
+        });
     }
-    
-    string getConnection() {
-        return connectionString;
+
+    void log(const string& message) {
+        log(message.data(), message.size());
+    }
+
+    // Structured record: only the call-site id and raw arguments are copied.
+    template <typename... Args>
+    void logArgs(uint32_t siteId, const Args&... args) {
+        logRecord([&](LogRecord& record) {
+            record.siteId = siteId;
+            record.length = (uint32_t)LogArgs::encode(record.payload, LogRecord::kPayloadBytes, args...);
+        });
+    }
+
+    // Blocks until everything logged so far by this thread is in the file.
+    void flush() {
+        uint64_t target = flushedGeneration.load(memory_order_acquire) + 2;
+        while (flushedGeneration.load(memory_order_acquire) < target) {
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+
+    uint64_t droppedCount() const {
+        return dropped.load(memory_order_relaxed);
     }
 };
 
-// Initialize static member
-LazyDatabaseConnection* LazyDatabaseConnection::instance = nullptr;
+thread_local AsyncLogger::ThreadRegistration AsyncLogger::registration;
+atomic<uint64_t> AsyncLogger::nextLoggerId(1);
+
+// Offline decoder for LogFileFormat::Binary files (run with --decode <file>).
+int decodeBinaryLog(const string& path) {
+    ifstream in(path, ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (data.compare(0, 6, "BLOG1\n") != 0) {
+        cerr << path << " is not a binary log" << endl;
+        return 1;
+    }
+    struct Site {
+        int level;
+        string file;
+        uint32_t line;
+        string format;
+        vector<size_t> offsets;
+    };
+    unordered_map<uint32_t, Site> sites;
+    // Every read is checked against the end of the file; a torn tail (crash
+    // mid-write) ends decoding instead of reading past the buffer.
+    auto readShortString = [&](size_t& pos, string& out) {
+        uint16_t n;
+        if (data.size() - pos < 2) return false;
+        memcpy(&n, data.data() + pos, 2);
+        if (data.size() - pos - 2 < n) return false;
+        out.assign(data, pos + 2, n);
+        pos += 2 + n;
+        return true;
+    };
+
+    size_t pos = 6;
+    while (pos < data.size()) {
+        size_t entryStart = pos;
+        char kind = data[pos++];
+        if (kind == 'N') {
+            sites.clear();
+        } else if (kind == 'S') {
+            uint32_t id;
+            uint8_t level;
+            Site site;
+            bool complete = data.size() - pos >= 9;
+            if (complete) {
+                memcpy(&id, data.data() + pos, 4);
+                memcpy(&level, data.data() + pos + 4, 1);
+                memcpy(&site.line, data.data() + pos + 5, 4);
+                pos += 9;
+                site.level = level;
+            }
+            if (!complete || !readShortString(pos, site.file) || !readShortString(pos, site.format)) {
+                cerr << "truncated entry at byte " << entryStart << ", stopping" << endl;
+                return 0;
+            }
+            for (size_t i = 0; i + 1 < site.format.size(); i++) {
+                if (site.format[i] == '{' && site.format[i + 1] == '}') site.offsets.push_back(i++);
+            }
+            sites[id] = site;
+        } else if (kind == 'R') {
+            int64_t wall;
+            uint32_t id;
+            string payload;
+            if (data.size() - pos < 12) {
+                cerr << "truncated entry at byte " << entryStart << ", stopping" << endl;
+                return 0;
+            }
+            memcpy(&wall, data.data() + pos, 8);
+            memcpy(&id, data.data() + pos + 8, 4);
+            pos += 12;
+            if (!readShortString(pos, payload)) {
+                cerr << "truncated entry at byte " << entryStart << ", stopping" << endl;
+                return 0;
+            }
+
+            time_t seconds = wall / 1000000000;
+            tm local;
+            localtime_r(&seconds, &local);
+            char stamp[32];
+            size_t n = strftime(stamp, sizeof(stamp), "%H:%M:%S", &local);
+            snprintf(stamp + n, sizeof(stamp) - n, ".%06lld ", (long long)(wall % 1000000000) / 1000);
+            string line = stamp;
+            auto site = sites.find(id);
+            if (site == sites.end()) {
+                line += payload;
+            } else {
+                line += "[" + string(logLevelName(site->second.level)) + "] ";
+                LogArgs::format(site->second.format.c_str(), site->second.offsets.data(), site->second.offsets.size(),
+                                payload.data(), payload.size(), line);
+            }
+            cout << line << '\n';
+        } else {
+            cerr << "corrupt entry at byte " << entryStart << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
 
 // ========================================================================
 // 2. EAGER INITIALIZATION SINGLETON (Thread-Safe by default)
@@ -77,6 +1386,7 @@ LazyDatabaseConnection* LazyDatabaseConnection::instance = nullptr;
 class EagerLogger {
 private:
     static EagerLogger* instance;
+    unique_ptr<AsyncLogger> backend;
     
     // Private constructor
     EagerLogger() {
@@ -93,22 +1403,497 @@ public:
         return instance;
     }
     
+    // After this, log() no longer touches cout; lines go to a rotating file
+    // written by a background thread. The instance is never destroyed, so
+    // an atexit hook drains whatever is still in the rings.
+    void enableAsync(const string& path, LogFileFormat format = LogFileFormat::Text) {
+        if (backend) return;
+        backend.reset(new AsyncLogger(path, 4096, 64 << 20, 5, OverflowPolicy::Drop, format));
+        static bool drainAtExit = (atexit([] { instance->disableAsync(); }), true);
+        (void)drainAtExit;
+    }
+
+    // Writes out everything logged so far and goes back to cout. No other
+    // thread may be logging while this runs.
+    void disableAsync() {
+        backend.reset();
+    }
+
+    // Target of the LOG_* macros. Without a backend the line is formatted
+    // right away and printed like log().
+    template <typename... Args>
+    void logAt(uint32_t siteId, const Args&... args) {
+        if (backend) {
+            backend->logArgs(siteId, args...);
+            return;
+        }
+        const LogSite* site = LogSites::get(siteId);
+        if (!site) return;
+        char payload[LogRecord::kPayloadBytes];
+        size_t length = LogArgs::encode(payload, sizeof(payload), args...);
+        string line;
+        LogArgs::format(site->format, site->offsets, site->count, payload, length, line);
+        cout << "[" << logLevelName(site->level) << "]: " << line << endl;
+    }
+
     void log(const string& message) {
+        if (backend) {
+            backend->log(message);
+            return;
+        }
         cout << "[LOG]: " << message << endl;
     }
+
+    void flush() {
+        if (backend) backend->flush();
+    }
 };
 
 // Eager initialization - created at program start
 EagerLogger* EagerLogger::instance = new EagerLogger();
 
+// Only used unevaluated, inside decltype: the argument count as a type.
+template <typename... Args>
+integral_constant<size_t, sizeof...(Args)> logArgCount(const Args&...);
+
+// The check sits outside `if constexpr` so compiled-out levels are checked too.
+#define LOG_AT(level, format, ...)                                                             \
+    do {                                                                                       \
+        static_assert(countPlaceholders(format) == decltype(logArgCount(__VA_ARGS__))::value,  \
+                      "log format placeholder count does not match the arguments");            \
+        if constexpr ((level) >= LOG_COMPILE_LEVEL) {                                          \
+            static constexpr auto logSpec = parseFormat<countPlaceholders(format)>(format);    \
+            static const uint32_t logSiteId = LogSites::add(                                   \
+                {(level), __FILE__, __LINE__, (format), logSpec.offsets, logSpec.count});      \
+            EagerLogger::getInstance()->logAt(logSiteId, ##__VA_ARGS__);                       \
+        }                                                                                      \
+    } while (0)
+
+#define LOG_TRACE(format, ...) LOG_AT(LOG_LEVEL_TRACE, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+// ========================================================================
+// CONFIG STORE behind ThreadSafeConfig (RCU-style, wait-free reads)
+// ========================================================================
+// Readers never lock: they announce themselves in a per-thread slot, load
+// the current immutable snapshot through an atomic pointer and read it.
+// Writers build a complete new snapshot, swap the pointer and retire the
+// old one; it is deleted only once no reader that might still see it is
+// active (epoch-based deferred reclamation).
+typedef variant<bool, long long, double, string> ConfigValue;
+
+// Immutable key -> typed value map. Never modified after publication.
+class ConfigSnapshot {
+private:
+    unordered_map<string, ConfigValue> values;
+    uint64_t version = 0;
+
+    friend class ConfigStore;
+
+public:
+    template <typename T>
+    optional<T> get(const string& key) const {
+        auto it = values.find(key);
+        if (it == values.end()) return nullopt;
+        if (const T* value = get_if<T>(&it->second)) return *value;
+        return nullopt;
+    }
+
+    const unordered_map<string, ConfigValue>& all() const {
+        return values;
+    }
+
+    uint64_t getVersion() const {
+        return version;
+    }
+};
+
+// A batch of changes under one key prefix, coalesced to the latest value
+// per key. Every change is visible in snapshots with version >= version.
+struct ConfigNotification {
+    uint64_t firstVersion;  // oldest update folded into this batch
+    uint64_t version;
+    vector<pair<string, optional<ConfigValue>>> changes;  // nullopt = key removed
+};
+
+typedef function<void(const ConfigNotification&)> ConfigListener;
+
+class ConfigStore {
+private:
+    // One cache line per reader thread, so readers never write shared lines.
+    struct alignas(64) ReaderSlot {
+        atomic<uint64_t> epoch{0};  // epoch the reader entered in, 0 = idle
+        atomic<bool> claimed{false};
+    };
+    static constexpr size_t kMaxReaderThreads = 1024;
+    static ReaderSlot slots[kMaxReaderThreads];
+    static atomic<uint64_t> globalEpoch;
+
+    // Claims a slot on a thread's first read and frees it at thread exit.
+    struct SlotHandle {
+        ReaderSlot* slot = nullptr;
+        int depth = 0;  // nested reads on the same thread
+        ~SlotHandle() {
+            if (slot) slot->claimed.store(false, memory_order_release);
+        }
+    };
+    static thread_local SlotHandle threadSlot;
+
+    static ReaderSlot& mySlot() {
+        if (!threadSlot.slot) {
+            for (auto& slot : slots) {
+                bool expected = false;
+                if (slot.claimed.compare_exchange_strong(expected, true)) {
+                    threadSlot.slot = &slot;
+                    break;
+                }
+            }
+            if (!threadSlot.slot) throw runtime_error("ConfigStore: too many reader threads");
+        }
+        return *threadSlot.slot;
+    }
+
+    atomic<const ConfigSnapshot*> current;
+    mutex writerMtx;  // writers only; readers never touch it
+    vector<pair<const ConfigSnapshot*, uint64_t>> retired;
+
+    thread watcher;
+    mutex watchMtx;
+    condition_variable watchCv;
+    bool stopWatching = false;
+
+    // Subscriptions: writers only merge their changes into `pending`; a
+    // notifier thread waits until updates pause for coalesceWindow (or
+    // maxBatchDelay has passed) so a burst becomes a few batches, then runs
+    // the listeners outside any lock.
+    struct Subscriber {
+        uint64_t id;
+        string prefix;
+        ConfigListener listener;
+    };
+    mutex notifyMtx;
+    condition_variable notifyCv;
+    vector<shared_ptr<Subscriber>> subscribers;
+    uint64_t nextSubscriberId = 1;
+    atomic<bool> hasSubscribers{false};
+    map<string, optional<ConfigValue>> pending;  // ordered for prefix ranges
+    uint64_t pendingFirstVersion = 0, pendingVersion = 0;
+    bool delivering = false;
+    bool stopNotifier = false;
+    condition_variable drainedCv;
+    chrono::milliseconds coalesceWindow{5};
+    chrono::milliseconds maxBatchDelay{100};
+    thread notifier;
+
+    // Caller holds writerMtx, so batches are queued in version order.
+    // changedKeys == nullptr diffs the whole snapshot (file reloads).
+    void queueChanges(const ConfigSnapshot& old, const ConfigSnapshot& next, const vector<string>* changedKeys) {
+        vector<string> keys;
+        if (changedKeys) {
+            keys = *changedKeys;
+        } else {
+            for (auto& entry : next.values) {
+                auto it = old.values.find(entry.first);
+                if (it == old.values.end() || !(it->second == entry.second)) keys.push_back(entry.first);
+            }
+            for (auto& entry : old.values) {
+                if (!next.values.count(entry.first)) keys.push_back(entry.first);
+            }
+        }
+        if (keys.empty()) return;
+        lock_guard<mutex> lock(notifyMtx);
+        bool wasEmpty = pending.empty();
+        if (wasEmpty) pendingFirstVersion = next.version;
+        pendingVersion = next.version;
+        for (auto& key : keys) {
+            auto it = next.values.find(key);
+            pending[key] = it == next.values.end() ? nullopt : optional<ConfigValue>(it->second);
+        }
+        if (wasEmpty) notifyCv.notify_one();
+    }
+
+    void runNotifier() {
+        unique_lock<mutex> lock(notifyMtx);
+        while (true) {
+            notifyCv.wait(lock, [this] { return stopNotifier || !pending.empty(); });
+            if (stopNotifier) return;
+            auto batchStart = chrono::steady_clock::now();
+            while (true) {
+                uint64_t seen = pendingVersion;
+                notifyCv.wait_for(lock, coalesceWindow, [this] { return stopNotifier; });
+                if (stopNotifier) return;
+                if (pendingVersion == seen || chrono::steady_clock::now() - batchStart >= maxBatchDelay) break;
+            }
+
+            map<string, optional<ConfigValue>> batch;
+            batch.swap(pending);
+            uint64_t firstVersion = pendingFirstVersion, version = pendingVersion;
+            vector<shared_ptr<Subscriber>> targets = subscribers;
+            delivering = true;
+            lock.unlock();
+
+            for (auto& subscriber : targets) {
+                ConfigNotification notification;
+                notification.firstVersion = firstVersion;
+                notification.version = version;
+                for (auto it = batch.lower_bound(subscriber->prefix);
+                     it != batch.end() && it->first.compare(0, subscriber->prefix.size(), subscriber->prefix) == 0; ++it) {
+                    notification.changes.push_back(*it);
+                }
+                if (!notification.changes.empty()) subscriber->listener(notification);
+            }
+
+            lock.lock();
+            delivering = false;
+            if (pending.empty()) drainedCv.notify_all();
+        }
+    }
+
+    // Caller holds writerMtx.
+    void publish(ConfigSnapshot* next, const vector<string>* changedKeys) {
+        const ConfigSnapshot* old = current.load(memory_order_relaxed);
+        next->version = old->version + 1;
+        current.store(next, memory_order_seq_cst);
+        if (hasSubscribers.load(memory_order_acquire)) queueChanges(*old, *next, changedKeys);
+        // Readers that entered at an epoch <= retireEpoch may still hold old.
+        uint64_t retireEpoch = globalEpoch.fetch_add(1, memory_order_seq_cst);
+        retired.push_back({old, retireEpoch});
+        reclaim();
+    }
+
+    // Caller holds writerMtx.
+    void reclaim() {
+        uint64_t oldestActive = UINT64_MAX;
+        for (auto& slot : slots) {
+            uint64_t epoch = slot.epoch.load(memory_order_seq_cst);
+            if (epoch != 0) oldestActive = min(oldestActive, epoch);
+        }
+        auto it = retired.begin();
+        while (it != retired.end()) {
+            if (it->second < oldestActive) {
+                delete it->first;
+                it = retired.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static bool parseValue(const string& text, ConfigValue& value) {
+        if (text == "true" || text == "false") {
+            value = (text == "true");
+            return true;
+        }
+        if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+            value = text.substr(1, text.size() - 2);
+            return true;
+        }
+        char* end = nullptr;
+        errno = 0;
+        long long integer = strtoll(text.c_str(), &end, 10);
+        if (errno == 0 && !text.empty() && *end == '\0') {
+            value = integer;
+            return true;
+        }
+        double real = strtod(text.c_str(), &end);
+        if (!text.empty() && *end == '\0') {
+            value = real;
+            return true;
+        }
+        value = text;
+        return true;
+    }
+
+    static string trim(const string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == string::npos) return "";
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+public:
+    // RAII read section. The snapshot stays valid for the guard's lifetime.
+    class ReadGuard {
+    private:
+        const ConfigSnapshot* snapshot;
+
+    public:
+        ReadGuard(const ConfigStore& store) {
+            ReaderSlot& slot = mySlot();
+            if (threadSlot.depth++ == 0) {
+                slot.epoch.store(globalEpoch.load(memory_order_acquire), memory_order_seq_cst);
+            }
+            snapshot = store.current.load(memory_order_seq_cst);
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard() {
+            if (--threadSlot.depth == 0) {
+                threadSlot.slot->epoch.store(0, memory_order_release);
+            }
+        }
+
+        const ConfigSnapshot& operator*() const { return *snapshot; }
+        const ConfigSnapshot* operator->() const { return snapshot; }
+    };
+
+    ConfigStore() {
+        current.store(new ConfigSnapshot());
+    }
+
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    ~ConfigStore() {
+        {
+            lock_guard<mutex> lock(watchMtx);
+            stopWatching = true;
+        }
+        watchCv.notify_all();
+        if (watcher.joinable()) watcher.join();
+        {
+            lock_guard<mutex> lock(notifyMtx);
+            stopNotifier = true;
+        }
+        notifyCv.notify_all();
+        if (notifier.joinable()) notifier.join();
+        for (auto& entry : retired) delete entry.first;
+        delete current.load();
+    }
+
+    ReadGuard read() const {
+        return ReadGuard(*this);
+    }
+
+    // Convenience read of a single value (copied out).
+    template <typename T>
+    T get(const string& key, T defaultValue) const {
+        ReadGuard snapshot(*this);
+        optional<T> value = snapshot->get<T>(key);
+        return value ? *value : defaultValue;
+    }
+
+    void set(const string& key, ConfigValue value) {
+        lock_guard<mutex> lock(writerMtx);
+        ConfigSnapshot* next = new ConfigSnapshot(*current.load(memory_order_relaxed));
+        next->values[key] = move(value);
+        vector<string> changed = {key};
+        publish(next, &changed);
+    }
+
+    // Replaces the whole configuration with the file's "key = value" lines
+    // in one pointer swap. On any parse error nothing is published.
+    bool loadFromFile(const string& path) {
+        ifstream in(path);
+        if (!in) return false;
+        ConfigSnapshot* next = new ConfigSnapshot();
+        string line;
+        while (getline(in, line)) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) continue;
+            size_t equals = line.find('=');
+            ConfigValue value;
+            if (equals == string::npos || trim(line.substr(0, equals)).empty()
+                || !parseValue(trim(line.substr(equals + 1)), value)) {
+                delete next;
+                return false;
+            }
+            next->values[trim(line.substr(0, equals))] = value;
+        }
+        lock_guard<mutex> lock(writerMtx);
+        publish(next, nullptr);
+        return true;
+    }
+
+    // Calls listener on the notifier thread with batches of changes to keys
+    // starting with prefix ("" = every key). Updates arriving within
+    // coalesceWindow of each other are delivered as one batch, held back
+    // at most maxBatchDelay.
+    uint64_t subscribe(const string& prefix, ConfigListener listener) {
+        lock_guard<mutex> lock(notifyMtx);
+        if (!notifier.joinable()) notifier = thread(&ConfigStore::runNotifier, this);
+        auto subscriber = make_shared<Subscriber>();
+        subscriber->id = nextSubscriberId++;
+        subscriber->prefix = prefix;
+        subscriber->listener = move(listener);
+        subscribers.push_back(subscriber);
+        hasSubscribers.store(true, memory_order_release);
+        return subscriber->id;
+    }
+
+    // A batch already being delivered may still reach the listener.
+    void unsubscribe(uint64_t id) {
+        lock_guard<mutex> lock(notifyMtx);
+        subscribers.erase(remove_if(subscribers.begin(), subscribers.end(),
+                                    [id](const shared_ptr<Subscriber>& s) { return s->id == id; }),
+                          subscribers.end());
+        hasSubscribers.store(!subscribers.empty(), memory_order_release);
+    }
+
+    // Blocks until every queued change has been delivered.
+    void drainNotifications() {
+        unique_lock<mutex> lock(notifyMtx);
+        drainedCv.wait(lock, [this] { return (pending.empty() || stopNotifier) && !delivering; });
+    }
+
+    void setCoalescing(chrono::milliseconds window, chrono::milliseconds maxDelay) {
+        lock_guard<mutex> lock(notifyMtx);
+        coalesceWindow = window;
+        maxBatchDelay = maxDelay;
+    }
+
+    // Polls the file and reloads it whenever its mtime or size changes.
+    // Watching a new file stops the previous watcher first.
+    void watchFile(const string& path, chrono::milliseconds interval) {
+        if (watcher.joinable()) {
+            {
+                lock_guard<mutex> lock(watchMtx);
+                stopWatching = true;
+            }
+            watchCv.notify_all();
+            watcher.join();
+            lock_guard<mutex> lock(watchMtx);
+            stopWatching = false;
+        }
+        watcher = thread([this, path, interval] {
+            struct stat last = {};
+            unique_lock<mutex> lock(watchMtx);
+            while (!stopWatching) {
+                struct stat now = {};
+                if (::stat(path.c_str(), &now) == 0
+                    && (now.st_mtim.tv_sec != last.st_mtim.tv_sec || now.st_mtim.tv_nsec != last.st_mtim.tv_nsec
+                        || now.st_size != last.st_size)) {
+                    last = now;
+                    lock.unlock();
+                    loadFromFile(path);
+                    lock.lock();
+                }
+                watchCv.wait_for(lock, interval, [this] { return stopWatching; });
+            }
+        });
+    }
+};
+
+ConfigStore::ReaderSlot ConfigStore::slots[ConfigStore::kMaxReaderThreads];
+atomic<uint64_t> ConfigStore::globalEpoch(1);
+thread_local ConfigStore::SlotHandle ConfigStore::threadSlot;
+
 // ========================================================================
 // 3. THREAD-SAFE SINGLETON with DOUBLE-CHECKED LOCKING
 // ========================================================================
 class ThreadSafeConfig {
 private:
-    static ThreadSafeConfig* instance;
+    // Atomic so the unlocked first check is not a data race: the release
+    // store publishes a fully constructed object to acquire loads.
+    static atomic<ThreadSafeConfig*> instance;
     static mutex mtx;
     string configData;
+    ConfigStore store;
     
     // Private constructor
     ThreadSafeConfig() {
@@ -125,28 +1910,48 @@ public:
     // Thread-safe getInstance with double-checked locking
     static ThreadSafeConfig* getInstance() {
         // First check without locking (performance optimization)
-        if (instance == nullptr) {
+        ThreadSafeConfig* config = instance.load(memory_order_acquire);
+        if (config == nullptr) {
             lock_guard<mutex> lock(mtx);  // Lock for thread safety
             // Second check with locking
-            if (instance == nullptr) {
-                instance = new ThreadSafeConfig();
+            config = instance.load(memory_order_relaxed);
+            if (config == nullptr) {
+                config = new ThreadSafeConfig();
+                instance.store(config, memory_order_release);
             }
         }
-        return instance;
+        return config;
     }
     
+    // Writers go to the config store; the instance mutex is not involved.
     void setConfig(const string& key, const string& value) {
-        lock_guard<mutex> lock(mtx);
+        store.set(key, value);
         cout << "Config set: " << key << " = " << value << endl;
     }
     
     string getConfig() {
         return configData;
     }
+
+    // Wait-free lookup of a typed value.
+    template <typename T>
+    T getConfig(const string& key, T defaultValue) {
+        return store.get<T>(key, defaultValue);
+    }
+
+    // Change notifications for keys under prefix, delivered off the
+    // writer's thread (see ConfigStore::subscribe).
+    uint64_t subscribe(const string& prefix, ConfigListener listener) {
+        return store.subscribe(prefix, move(listener));
+    }
+
+    ConfigStore& getStore() {
+        return store;
+    }
 };
 
 // Initialize static members
-ThreadSafeConfig* ThreadSafeConfig::instance = nullptr;
+atomic<ThreadSafeConfig*> ThreadSafeConfig::instance(nullptr);
 mutex ThreadSafeConfig::mtx;
 
 // ========================================================================
@@ -175,6 +1980,52 @@ public:
     }
 };
 
+// ========================================================================
+// 5. SINGLETON HOLDER (thread-local cached pointer)
+// ========================================================================
+// Every variant above pays something per call: a mutex, an acquire load of
+// a shared pointer, or the guard check of a function-local static. Here each
+// thread resolves the instance once and then reads its own thread-local
+// pointer, so the steady-state path is one load and never writes to memory
+// shared with other threads.
+// T makes its constructor private and befriends SingletonHolder<T>.
+template <typename T>
+class SingletonHolder {
+private:
+    static T& create() {
+        static T instance;  // thread-safe one-time construction
+        return instance;
+    }
+
+public:
+    static T& get() {
+        static thread_local T* cached = nullptr;  // constant-initialized, no TLS guard
+        if (cached == nullptr) {
+            cached = &create();
+        }
+        return *cached;
+    }
+};
+
+class AppSettings {
+private:
+    friend class SingletonHolder<AppSettings>;
+    string environment;
+
+    AppSettings() {
+        environment = "production";
+        cout << "AppSettings created!" << endl;
+    }
+
+public:
+    AppSettings(const AppSettings&) = delete;
+    AppSettings& operator=(const AppSettings&) = delete;
+
+    const string& getEnvironment() const {
+        return environment;
+    }
+};
+
 // ========================================================================
 // TESTING MULTITHREADING
 // ========================================================================
@@ -184,10 +2035,174 @@ void threadFunction(int threadId) {
     config->setConfig("Thread" + to_string(threadId), "Value" + to_string(threadId));
 }
 
+// ========================================================================
+// SINGLETON ACCESS BENCHMARK (run with --bench-singleton [calls per thread])
+// ========================================================================
+// Copy of singleton.cpp: a global lock_guard on every call, even after the
+// instance exists. Kept here so all variants run in one binary.
+class GlobalLockSingleton {
+private:
+    static GlobalLockSingleton* instance;
+    static mutex mtx;
+    GlobalLockSingleton() {}
+
+public:
+    static GlobalLockSingleton* getInstance() {
+        lock_guard<mutex> lock(mtx);
+        if (instance == nullptr) {
+            instance = new GlobalLockSingleton();
+        }
+        return instance;
+    }
+};
+
+GlobalLockSingleton* GlobalLockSingleton::instance = nullptr;
+mutex GlobalLockSingleton::mtx;
+
+// Per-thread hardware cache-miss counter; -1 where perf events are not
+// available (containers, perf_event_paranoid), in which case the slowdown
+// column is the contention signal.
+class CacheMissCounter {
+private:
+    int fd = -1;
+
+public:
+    CacheMissCounter() {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~CacheMissCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    long long read() const {
+        long long value = 0;
+        if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+        return value;
+    }
+};
+
+// Stops the compiler from hoisting the instance load out of the loop.
+inline void benchmarkBarrier() {
+    asm volatile("" ::: "memory");
+}
+
+struct SingletonBenchResult {
+    double nsPerCall;        // thread CPU time, so oversubscription does not inflate it
+    double cacheMissesPerCall;  // -1 when unavailable
+};
+
+// Templated on the accessor so it inlines; a std::function call would cost
+// more than most of the variants being measured.
+template <typename Access>
+SingletonBenchResult benchSingletonAccess(Access access, int threads, long long callsPerThread) {
+    atomic<long long> totalNs(0), totalMisses(0);
+    atomic<bool> missesAvailable(true);
+    atomic<uintptr_t> sink(0);
+    atomic<int> ready(0);
+    atomic<bool> go(false);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&] {
+            access();  // first call may construct / fill a thread-local cache
+            CacheMissCounter misses;
+            ready++;
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            long long missesBefore = misses.read();
+            timespec start, end;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+            uintptr_t acc = 0;
+            for (long long i = 0; i < callsPerThread; i++) {
+                acc ^= access();
+                benchmarkBarrier();
+            }
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+            long long missesAfter = misses.read();
+            totalNs += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+            if (missesBefore < 0 || missesAfter < 0) {
+                missesAvailable = false;
+            } else {
+                totalMisses += missesAfter - missesBefore;
+            }
+            sink ^= acc;
+        }));
+    }
+    while (ready.load() < threads) {
+        this_thread::yield();
+    }
+    go = true;
+    for (auto& th : workers) {
+        th.join();
+    }
+    double calls = double(callsPerThread) * threads;
+    SingletonBenchResult result;
+    result.nsPerCall = totalNs.load() / calls;
+    result.cacheMissesPerCall = missesAvailable.load() ? totalMisses.load() / calls : -1;
+    return result;
+}
+
+template <typename Access>
+void benchSingletonVariant(const string& name, Access access, long long callsPerThread) {
+    cout << name << endl;
+    double baseline = 0;
+    for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        SingletonBenchResult result = benchSingletonAccess(access, threads, callsPerThread);
+        if (threads == 1) baseline = result.nsPerCall;
+        char line[160];
+        snprintf(line, sizeof(line), "  %2d threads: %7.2f ns/call  slowdown %5.2fx  cache misses/call %s",
+                 threads, result.nsPerCall, baseline > 0 ? result.nsPerCall / baseline : 0.0,
+                 result.cacheMissesPerCall < 0 ? "n/a" : to_string(result.cacheMissesPerCall).c_str());
+        cout << line << endl;
+    }
+}
+
+void runSingletonBenchmark(long long callsPerThread) {
+    // Construct everything up front; LazyDatabaseConnection is only safe to
+    // share once its instance exists.
+    LazyDatabaseConnection::getInstance();
+    ThreadSafeConfig::getInstance();
+    MeyersSingleton::getInstance();
+    SingletonHolder<AppSettings>::get();
+    GlobalLockSingleton::getInstance();
+
+    cout << "Singleton access, " << callsPerThread << " calls per thread, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << "ns/call is thread CPU time; slowdown is ns/call relative to 1 thread" << endl;
+    benchSingletonVariant("global lock (singleton.cpp)",
+                          [] { return (uintptr_t)GlobalLockSingleton::getInstance(); }, callsPerThread);
+    benchSingletonVariant("lazy, unsynchronized",
+                          [] { return (uintptr_t)LazyDatabaseConnection::getInstance(); }, callsPerThread);
+    benchSingletonVariant("eager",
+                          [] { return (uintptr_t)EagerLogger::getInstance(); }, callsPerThread);
+    benchSingletonVariant("double-checked locking",
+                          [] { return (uintptr_t)ThreadSafeConfig::getInstance(); }, callsPerThread);
+    benchSingletonVariant("Meyers (static local)",
+                          [] { return (uintptr_t)&MeyersSingleton::getInstance(); }, callsPerThread);
+    benchSingletonVariant("SingletonHolder (thread-local)",
+                          [] { return (uintptr_t)&SingletonHolder<AppSettings>::get(); }, callsPerThread);
+}
+
 // ========================================================================
 // MAIN FUNCTION - DEMONSTRATION
 // ========================================================================
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 2 && string(argv[1]) == "--decode") {
+        return decodeBinaryLog(argv[2]);
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-singleton") {
+        runSingletonBenchmark(argc > 2 ? atoll(argv[2]) : 1000000);
+        return 0;
+    }
+
     cout << "========== SINGLETON DESIGN PATTERN EXAMPLES ==========" << endl;
     cout << endl;
     
@@ -200,6 +2215,11 @@ int main() {
     cout << "db2 address: " << db2 << endl;
     cout << "Same instance? " << (db1 == db2 ? "YES" : "NO") << endl;
     db1->query("SELECT * FROM users");
+    db1->query("SELECT name FROM users WHERE id = 7");
+    db1->query("select name   from users where id = 42");   // same plan, literal rebound
+    db2->execute("SELECT name FROM users WHERE email = ?", {sqlQuote("o'neil@example.com")});
+    StatementCacheStats statementStats = db1->statementStats();
+    cout << "Statement cache: " << statementStats.hits << " hits, " << statementStats.misses << " misses" << endl;
     cout << endl;
     
     // 2. Eager Initialization Example
@@ -232,13 +2252,148 @@ int main() {
     cout << "ms2 address: " << &ms2 << endl;
     cout << "Same instance? " << (&ms1 == &ms2 ? "YES" : "NO") << endl;
     ms1.doSomething();
+    AppSettings& settings = SingletonHolder<AppSettings>::get();
+    cout << "SingletonHolder<AppSettings> (thread-local cached): " << settings.getEnvironment()
+         << ", same instance? " << (&settings == &SingletonHolder<AppSettings>::get() ? "YES" : "NO") << endl;
+    cout << "Compare access costs with: " << argv[0] << " --bench-singleton" << endl;
     cout << endl;
     
+    // 5. Config store: wait-free reads while a file reload swaps the snapshot
+    cout << "5. RCU CONFIG STORE (hot reload):" << endl;
+    string configPath = "/tmp/singleton-demo-" + to_string(::getpid()) + ".conf";
+    ofstream(configPath) << "# demo config\nmax_connections = 64\nratio = 0.75\nfeature_x = true\nregion = \"eu-west\"\n";
+    ConfigStore& store = ThreadSafeConfig::getInstance()->getStore();
+    store.loadFromFile(configPath);
+    ::unlink(configPath.c_str());
+    atomic<bool> reading(true);
+    atomic<long long> reads(0);
+    vector<thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.push_back(thread([&] {
+            while (reading.load(memory_order_relaxed)) {
+                ConfigStore::ReadGuard config = store.read();
+                if (config->get<long long>("max_connections")) reads.fetch_add(1, memory_order_relaxed);
+            }
+        }));
+    }
+    for (int i = 0; i < 100; i++) {
+        store.set("max_connections", 64LL + i);
+    }
+    reading = false;
+    for (auto& th : readers) {
+        th.join();
+    }
+    ConfigStore::ReadGuard config = store.read();
+    cout << "Reads during updates: " << reads.load() << ", version " << config->getVersion()
+         << ", max_connections = " << *config->get<long long>("max_connections")
+         << ", region = " << *config->get<string>("region") << endl;
+
+    // Subscribers see a 10K-update burst as a few coalesced batches.
+    atomic<int> batches(0);
+    atomic<uint64_t> lastVersion(0);
+    long long lastPoolSize = 0;
+    uint64_t subscription = ThreadSafeConfig::getInstance()->subscribe("pool.", [&](const ConfigNotification& n) {
+        batches++;
+        lastVersion = n.version;
+        for (auto& change : n.changes) {
+            if (change.first == "pool.size" && change.second) lastPoolSize = get<long long>(*change.second);
+        }
+    });
+    for (long long i = 1; i <= 10000; i++) {
+        store.set("pool.size", i);
+        store.set("cache.ttl", i);  // no subscriber for this prefix
+    }
+    store.drainNotifications();
+    store.unsubscribe(subscription);
+    cout << "20000 updates -> " << batches.load() << " batched callbacks, last version " << lastVersion.load()
+         << ", pool.size = " << lastPoolSize << endl;
+    cout << endl;
+
+    // 6. Async logging: callers only copy a call-site id and raw arguments
+    //    into a per-thread ring; formatting happens offline (--decode).
+    cout << "6. ASYNC LOGGER BEHIND EagerLogger:" << endl;
+    string logPath = "/tmp/singleton-demo-" + to_string(::getpid()) + ".blog";
+    logger1->enableAsync(logPath, LogFileFormat::Binary);
+    // Each caller's own CPU time: wall time would also count the other
+    // threads (and the writer) sharing the cores.
+    auto threadCpuNs = [] {
+        timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+    };
+    atomic<long long> logNanos(0);
+    vector<thread> loggers;
+    for (int t = 0; t < 4; t++) {
+        loggers.push_back(thread([t, &logNanos, threadCpuNs] {
+            // Warm-up: the first call registers the thread's ring and faults
+            // in its pages, which is not what a steady-state call costs.
+            for (int i = 0; i < 100; i++) {
+                LOG_INFO("worker {} warming up {}", t, i);
+            }
+            long long start = threadCpuNs();
+            for (int i = 0; i < 1000; i++) {
+                LOG_INFO("worker {} handled request {}", t, i);
+                LOG_DEBUG("request {} details: {}", i, "compiled out below LOG_COMPILE_LEVEL");
+            }
+            logNanos += threadCpuNs() - start;
+        }));
+    }
+    for (auto& th : loggers) {
+        th.join();
+    }
+    logger1->log("plain messages still work");
+    logger1->disableAsync();
+    struct stat logStat = {};
+    ::stat(logPath.c_str(), &logStat);
+    cout << "Logged 4000 timed records (" << logStat.st_size << " bytes of binary log), ~"
+         << logNanos.load() / 4000 << " ns of caller CPU per call" << endl;
+    cout << "Binary logs decode with: " << argv[0] << " --decode <file>" << endl;
+    ::unlink(logPath.c_str());
+    cout << endl;
+
+    // 7. Connection pool: many threads, a few connections, one fake server
+    cout << "7. CONNECTION POOL (instead of one shared connection):" << endl;
+    {
+        FakeDatabaseServer server(chrono::microseconds(500), chrono::microseconds(2000));
+        ConnectionPoolOptions options;
+        options.minIdle = 2;
+        options.maxSize = 4;
+        options.validateAfterIdle = chrono::milliseconds(0);  // always ping, to show recovery
+        ConnectionPool pool(server, options);
+        vector<thread> clients;
+        atomic<int> failures(0);
+        for (int t = 0; t < 8; t++) {
+            clients.push_back(thread([&pool, &failures, t] {
+                for (int i = 0; i < 20; i++) {
+                    ConnectionPool::Handle connection = pool.checkout();
+                    string result;
+                    if (!connection || !connection->query("SELECT * FROM orders WHERE id = " + to_string(t * 100 + i), result)) {
+                        failures++;
+                    }
+                }
+            }));
+        }
+        server.dropAllConnections();  // broken sessions are detected by the health check
+        for (auto& th : clients) {
+            th.join();
+        }
+        ConnectionPoolStats stats = pool.stats();
+        cout << "Queries: " << server.queryCount() << ", failed in flight during the drop: " << failures.load()
+             << ", connections opened: " << stats.created << ", failed health checks: " << stats.failedHealthChecks
+             << ", avg wait: " << (long)stats.averageWaitMicros << " us, max wait: " << (long)stats.maxWaitMicros
+             << " us, timeouts: " << stats.timeouts << endl;
+        cout << "Statement cache: " << stats.statements.hits << " hits / " << stats.statements.misses
+             << " misses (hit ratio " << stats.statements.hitRatio << "), parse time saved: "
+             << stats.statements.parseNanosSaved / 1000 << " us" << endl;
+    }
+    cout << endl;
+
     cout << "========== COMPARISON ==========" << endl;
     cout << "Lazy: Created when first needed, not thread-safe" << endl;
     cout << "Eager: Created at program start, thread-safe" << endl;
-    cout << "Thread-Safe: Lazy + mutex + double-checked locking" << endl;
+    cout << "Thread-Safe: Lazy + mutex + double-checked locking (atomic pointer)" << endl;
     cout << "Meyer's: Best approach in C++11+, automatic thread-safety" << endl;
+    cout << "SingletonHolder: Meyer's + thread-local cached pointer, one load per access" << endl;
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+/*
+ * FACTORY INSTRUMENTATION (opt-in)
+ * ================================
+ * Per product type: construction count, live objects, bytes created by
+ * factories and a construction-latency histogram, queryable at runtime and
+ * dumpable as JSON. Shared by the vehicle factory, the document editor and
+ * the robot strategies.
+ *
+ * Build with -DFACTORY_INSTRUMENTATION to turn it on. Without it every
+ * macro expands to the bare expression (or to nothing), so the hooks can
+ * stay in production code at zero cost.
+ *
+ *   class Car : public Vehicle {
+ *       FACTORY_TRACKED(Car)                       // constructed / live counts
+ *   };
+ *   auto car = FACTORY_CREATE(Car, sizeof(Car), make_unique<Car>());
+ *   FACTORY_DUMP_JSON(cout);
+ */
+
+#ifndef FACTORY_INSTRUMENTATION_H
+#define FACTORY_INSTRUMENTATION_H
+
+#ifdef FACTORY_INSTRUMENTATION
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+struct FactoryTypeStats {
+    static constexpr int kBuckets = 32;  // bucket b: latency < 2^b ns
+
+    std::string name;
+    std::atomic<uint64_t> constructed{0};
+    std::atomic<uint64_t> destroyed{0};
+    std::atomic<uint64_t> factoryCreated{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> latency[kBuckets] = {};
+
+    void recordCreation(uint64_t size, uint64_t ns) {
+        factoryCreated.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+        int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        latency[bucket < kBuckets ? bucket : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct FactoryTypeSnapshot {
+    std::string name;
+    uint64_t constructed;
+    uint64_t live;
+    uint64_t factoryCreated;
+    uint64_t bytes;
+    double averageNs;
+    std::vector<std::pair<uint64_t, uint64_t>> histogram;  // (upper bound ns, count), non-empty buckets
+};
+
+class FactoryInstrumentation {
+private:
+    static std::mutex& registryMutex() {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    // Entries are never removed, so references stay valid.
+    static std::vector<std::unique_ptr<FactoryTypeStats>>& registry() {
+        static std::vector<std::unique_ptr<FactoryTypeStats>> types;
+        return types;
+    }
+
+    static std::string demangle(const char* mangled) {
+        int status = 0;
+        char* readable = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+        std::string name = status == 0 && readable ? readable : mangled;
+        std::free(readable);
+        return name;
+    }
+
+    static FactoryTypeStats& lookup(const std::string& name) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (auto& stats : registry()) {
+            if (stats->name == name) return *stats;
+        }
+        registry().push_back(std::make_unique<FactoryTypeStats>());
+        registry().back()->name = name;
+        return *registry().back();
+    }
+
+public:
+    // One lookup per type; afterwards a cached reference.
+    template <typename T>
+    static FactoryTypeStats& of() {
+        static FactoryTypeStats& stats = lookup(demangle(typeid(T).name()));
+        return stats;
+    }
+
+    static std::vector<FactoryTypeSnapshot> snapshot() {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::vector<FactoryTypeSnapshot> result;
+        for (auto& stats : registry()) {
+            FactoryTypeSnapshot s;
+            s.name = stats->name;
+            s.constructed = stats->constructed.load();
+            s.live = s.constructed - stats->destroyed.load();
+            s.factoryCreated = stats->factoryCreated.load();
+            s.bytes = stats->bytes.load();
+            s.averageNs = s.factoryCreated ? double(stats->totalNs.load()) / s.factoryCreated : 0;
+            for (int b = 0; b < FactoryTypeStats::kBuckets; b++) {
+                uint64_t count = stats->latency[b].load();
+                if (count) s.histogram.push_back({1ULL << b, count});
+            }
+            result.push_back(s);
+        }
+        return result;
+    }
+
+    static void dumpJson(std::ostream& out) {
+        out << "{\"types\":[";
+        bool first = true;
+        for (auto& s : snapshot()) {
+            out << (first ? "" : ",") << "{\"name\":\"" << s.name << "\",\"constructed\":" << s.constructed
+                << ",\"live\":" << s.live << ",\"factory_created\":" << s.factoryCreated
+                << ",\"bytes\":" << s.bytes << ",\"avg_ns\":" << s.averageNs << ",\"latency_ns\":[";
+            for (size_t i = 0; i < s.histogram.size(); i++) {
+                out << (i ? "," : "") << "{\"lt\":" << s.histogram[i].first << ",\"count\":" << s.histogram[i].second << "}";
+            }
+            out << "]}";
+            first = false;
+        }
+        out << "]}\n";
+    }
+};
+
+// Member that counts constructions (copies included) and destructions.
+template <typename T>
+struct FactoryLifetime {
+    FactoryLifetime() {
+        FactoryInstrumentation::of<T>().constructed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    FactoryLifetime(const FactoryLifetime&) : FactoryLifetime() {}
+
+    FactoryLifetime& operator=(const FactoryLifetime&) {
+        return *this;
+    }
+
+    ~FactoryLifetime() {
+        FactoryInstrumentation::of<T>().destroyed.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Times one creation expression and attributes it to T.
+template <typename T>
+class FactoryCreationTimer {
+private:
+    uint64_t size;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit FactoryCreationTimer(uint64_t size) : size(size), start(std::chrono::steady_clock::now()) {}
+
+    ~FactoryCreationTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        FactoryInstrumentation::of<T>().recordCreation(size, (uint64_t)ns);
+    }
+};
+
+#define FACTORY_TRACKED(Type) FactoryLifetime<Type> factoryLifetime_;
+
+#define FACTORY_CREATE(Type, bytes, ...)                      \
+    ([&]() -> decltype(auto) {                                \
+        FactoryCreationTimer<Type> factoryTimer_(bytes);      \
+        return __VA_ARGS__;                                   \
+    }())
+
+#define FACTORY_DUMP_JSON(out) FactoryInstrumentation::dumpJson(out)
+
+#else
+
+#define FACTORY_TRACKED(Type)
+#define FACTORY_CREATE(Type, bytes, ...) (__VA_ARGS__)
+#define FACTORY_DUMP_JSON(out)
+
+#endif  // FACTORY_INSTRUMENTATION
+
+#endif  // FACTORY_INSTRUMENTATION_H
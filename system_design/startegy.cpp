@@ -87,6 +87,7 @@
 // }
 
 #include <bits/stdc++.h>
+#include "factory_instrumentation.h"
 using namespace std;
 
 // class walking{
@@ -268,6 +269,7 @@ class robot{
     virtual void display()=0;
 };
 class tesla:public robot{
+    FACTORY_TRACKED(tesla)
     public:
     tesla():robot(new walkable(),new notthink()){}
     void display(){
@@ -275,6 +277,7 @@ class tesla:public robot{
     }
 };
 class claude:public robot{
+    FACTORY_TRACKED(claude)
     public:
     claude():robot(new nommove(),new chatgpt()){}
     void display(){
@@ -305,8 +308,9 @@ int main(){
     // t.performrun();
     // t.display();
 
-    robot* b=new tesla;
-    robot* c=new claude;
+    // each robot also allocates its two strategies
+    robot* b=FACTORY_CREATE(tesla,sizeof(tesla)+sizeof(walkable)+sizeof(notthink),new tesla);
+    robot* c=FACTORY_CREATE(claude,sizeof(claude)+sizeof(nommove)+sizeof(chatgpt),new claude);
     b->thinking();
     b->moving();
     b->display();
@@ -317,6 +321,7 @@ int main(){
     c->display();
     delete b;
     delete c;
+    FACTORY_DUMP_JSON(cout);
 
     return 0;
 }
\ No newline at end of file